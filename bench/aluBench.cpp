@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "gameBoy.hpp"
+#include "Cartridge/cartridgeBuilder.hpp"
+
+#include "romImage.hpp"
+
+//Frames run before timing, the boot ROM needs some of them
+#define WARMUP_FRAMES 500
+#define TIMED_FRAMES 2000
+
+/**
+ * Times a ROM that runs 8-bit arithmetic with the LCD off, so the flag computation
+ * dominates. GBEMU_LAZY_FLAGS and GBEMU_ALU_TABLES are build options, compare builds
+ * configured with and without them.
+ */
+int main(int argc, char** argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 5;
+
+    //ADD/ADC/SUB/SBC/CP/INC/DEC/AND/OR/XOR in a loop, PUSH AF reads the flags every 256 iterations
+    const std::vector<uint8_t> program = {
+        0xF3, 0x31, 0xFE, 0xFF, 0xAF, 0xE0, 0x40, 0x0E, 0x13, 0x16, 0x77, 0x1E, 0x31, 0x26, 0xC1, 0x2E,
+        0x05, 0x06, 0x00, 0x81, 0x8A, 0x93, 0x9C, 0xBD, 0x0C, 0x15, 0xE6, 0xF7, 0xF6, 0x01, 0xEE, 0x5A,
+        0xC6, 0x9D, 0x1C, 0x25, 0xAD, 0xFE, 0x20, 0x38, 0x02, 0xCE, 0x11, 0xD6, 0x07, 0xDE, 0x02, 0x2C,
+        0xB4, 0x05, 0x20, 0xDF, 0xF5, 0xF1, 0x18, 0xD9
+    };
+
+    RomImage image(ROM_TYPE_STANDARD);
+    image.place(ROM_PROGRAM_START, program);
+    std::string romFile = image.write("gbemu_alu_bench.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the benchmark ROM\n");
+        return 1;
+    }
+
+    double best = 0;
+    for (int run = 0; run < runs; run++)
+    {
+        GameBoy gameBoy(CartridgeBuilder::openROM(romFile.c_str()));
+        for (int frame = 0; frame < WARMUP_FRAMES; frame++) gameBoy.runFrame();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < TIMED_FRAMES; frame++) gameBoy.runFrame();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run == 0 || seconds < best) best = seconds;
+    }
+
+#ifdef GBEMU_LAZY_FLAGS
+    const char* lazyFlags = "on";
+#else
+    const char* lazyFlags = "off";
+#endif
+#ifdef GBEMU_ALU_TABLES
+    const char* aluTables = "on";
+#else
+    const char* aluTables = "off";
+#endif
+
+    printf("GBEMU_LAZY_FLAGS %s, GBEMU_ALU_TABLES %s: %.1f us per frame, %.0f frames/s (best of %d)\n", lazyFlags, aluTables, best * 1e6 / TIMED_FRAMES, TIMED_FRAMES / best, runs);
+    return 0;
+}
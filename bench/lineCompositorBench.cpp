@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "Peripheral/lineCompositor.hpp"
+
+#define CHECKED_LINES 100000
+#define TIMED_LINES 2000000
+//Each implementation is timed this often and the fastest run counts, which filters out other load on the host
+#define TIMED_RUNS 5
+
+struct LineInput
+{
+    uint8_t background[LINE_WIDTH];
+    uint8_t objects[LINE_WIDTH];
+    LinePalettes palettes;
+};
+
+//About a third of the object pixels are transparent, the others use every attribute
+static void randomLine(std::mt19937& random, LineInput& line)
+{
+    for (int x = 0; x < LINE_WIDTH; x++)
+    {
+        line.background[x] = random() & 0x3;
+        line.objects[x] = random() % 3 == 0 ? 0 : random() & (OBJECT_COLOR_MASK | OBJECT_PALETTE_1 | OBJECT_BEHIND_BG);
+    }
+    for (int index = 0; index < 16; index++)
+    {
+        line.palettes.shades[index] = random() & 0x3;
+    }
+}
+
+static double nanosecondsPerLine(LineCompositor::ComposeFunction compose, LineInput& line)
+{
+    uint8_t shades[LINE_WIDTH];
+    volatile uint8_t sink = 0;
+
+    double best = 0;
+    for (int run = 0; run < TIMED_RUNS; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < TIMED_LINES; i++)
+        {
+            //Keeps the compiler from hoisting the call out of the loop
+            line.background[i % LINE_WIDTH] ^= 1;
+            compose(line.background, line.objects, line.palettes, shades);
+            sink = sink + shades[i % LINE_WIDTH];
+        }
+        double time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / TIMED_LINES;
+        if (run == 0 || time < best) best = time;
+    }
+    return best;
+}
+
+/**
+ * Checks every implementation the host supports against the scalar one on random lines,
+ * then times each of them per line, the best of TIMED_RUNS runs.
+ */
+int main()
+{
+    std::mt19937 random(160);
+    LineInput line;
+    std::vector<LineCompositor::Implementation> implementations = LineCompositor::implementations();
+
+    for (int i = 0; i < CHECKED_LINES; i++)
+    {
+        randomLine(random, line);
+
+        uint8_t expected[LINE_WIDTH];
+        LineCompositor::composeScalar(line.background, line.objects, line.palettes, expected);
+
+        for (const LineCompositor::Implementation& implementation : implementations)
+        {
+            uint8_t shades[LINE_WIDTH];
+            implementation.compose(line.background, line.objects, line.palettes, shades);
+            if (memcmp(shades, expected, LINE_WIDTH) != 0)
+            {
+                printf("%s differs from the scalar implementation on line %d\n", implementation.name, i);
+                return 1;
+            }
+        }
+    }
+
+    randomLine(random, line);
+    double scalar = nanosecondsPerLine(LineCompositor::composeScalar, line);
+
+    printf("compose() uses %s\n", LineCompositor::implementationName());
+    for (const LineCompositor::Implementation& implementation : implementations)
+    {
+        double time = nanosecondsPerLine(implementation.compose, line);
+        printf("%-6s %7.1f ns per line, %5.1fx the scalar speed\n", implementation.name, time, scalar / time);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+//Cartridge types of header byte 0x147 the cartridge builder knows
+#define ROM_TYPE_STANDARD 0x00
+#define ROM_TYPE_MBC1 0x01
+
+//Entry point the header jumps to
+#define ROM_PROGRAM_START 0x150
+
+/**
+ * @brief Builds minimal ROM images for benchmarks and tests. The image carries the
+ * Nintendo logo and header checksum the boot ROM checks, and jumps from 0x100 to
+ * the program placed at ROM_PROGRAM_START.
+ */
+class RomImage
+{
+
+public:
+
+    RomImage(uint8_t type, size_t banks = 2) : m_data(banks * 0x4000, 0)
+    {
+        static constexpr uint8_t LOGO[48] = {
+            0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+            0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+            0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+        };
+
+        //NOP; JP ROM_PROGRAM_START
+        const uint8_t entry[4] = { 0x00, 0xC3, ROM_PROGRAM_START & 0xFF, ROM_PROGRAM_START >> 8 };
+        place(0x100, entry, sizeof(entry));
+        place(0x104, LOGO, sizeof(LOGO));
+        m_data[0x147] = type;
+    }
+
+    void place(size_t address, const uint8_t* bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; i++) m_data[address + i] = bytes[i];
+    }
+
+    void place(size_t address, const std::vector<uint8_t>& bytes) { place(address, bytes.data(), bytes.size()); }
+
+    /**
+     * @brief Writes the image to the temp directory, returns the path or an empty string on failure
+     */
+    std::string write(const char* name)
+    {
+        uint8_t checksum = 0;
+        for (int i = 0x134; i < 0x14D; i++) checksum = checksum - m_data[i] - 1;
+        m_data[0x14D] = checksum;
+
+        std::string path = (std::filesystem::temp_directory_path() / name).string();
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) return "";
+
+        bool written = fwrite(m_data.data(), 1, m_data.size(), file) == m_data.size();
+        fclose(file);
+        return written ? path : "";
+    }
+
+private:
+
+    std::vector<uint8_t> m_data;
+};
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "include/gameBoy.hpp"
+#include "include/batchRunner.hpp"
+#include "include/saveState.hpp"
+#include "include/movie.hpp"
+#include "include/Cartridge/cartridgeBuilder.hpp"
+
+bool writeFrame(PictureProcessingUnit& ppu, const char* fileName)
+{
+    FILE* file = fopen(fileName, "wb");
+    if (!file) return false;
+
+    uint8_t pixels[V_RES * H_RES * 3];
+    ppu.convertFrame(PixelFormat::RGB888, pixels);
+
+    fprintf(file, "P6\n%d %d\n255\n", H_RES, V_RES);
+    fwrite(pixels, 1, sizeof(pixels), file);
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: GBEmuHeadless rom [rom...] [--frames N] [--instances N] [--threads N] [--quantum N] [--dump-frame out.ppm] [--load-state in.state] [--save-state out.state] [--render all|N|never] [--record out.movie] [--play in.movie] [--run-ahead N] [--cpu interpreter|blocks|jit]\n\n");
+        return 1;
+    }
+
+    long frames = 0;
+    long instances = 0;
+    long threads = 1;
+    long quantum = 1;
+    const char* dumpFile = nullptr;
+    const char* loadStateFile = nullptr;
+    const char* saveStateFile = nullptr;
+    const char* recordFile = nullptr;
+    const char* playFile = nullptr;
+    RenderPolicy renderPolicy = RenderPolicy::ALL;
+    long renderInterval = 1;
+    long runAhead = 0;
+    CpuBackend cpuBackend = CpuBackend::DECODED_BLOCKS;
+    std::vector<const char*> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = strtol(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+        {
+            instances = strtol(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = strtol(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc)
+        {
+            quantum = strtol(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--dump-frame") == 0 && i + 1 < argc)
+        {
+            dumpFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+        {
+            loadStateFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+        {
+            saveStateFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            recordFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+        {
+            playFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc)
+        {
+            runAhead = strtol(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc)
+        {
+            const char* backend = argv[++i];
+            if (strcmp(backend, "interpreter") == 0) cpuBackend = CpuBackend::INTERPRETER;
+            else if (strcmp(backend, "blocks") == 0) cpuBackend = CpuBackend::DECODED_BLOCKS;
+#ifdef GBEMU_JIT
+            else if (strcmp(backend, "jit") == 0) cpuBackend = CpuBackend::JIT;
+#endif
+            else
+            {
+                printf("Unknown CPU backend %s\n", backend);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc)
+        {
+            //A number renders every Nth frame
+            const char* mode = argv[++i];
+            if (strcmp(mode, "all") == 0) renderPolicy = RenderPolicy::ALL;
+            else if (strcmp(mode, "never") == 0) renderPolicy = RenderPolicy::NEVER;
+            else if ((renderInterval = strtol(mode, nullptr, 10)) > 0) renderPolicy = RenderPolicy::EVERY_NTH;
+            else
+            {
+                printf("Unknown render mode %s\n", mode);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--", 2) != 0)
+        {
+            roms.push_back(argv[i]);
+        }
+        else
+        {
+            printf("Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (roms.empty())
+    {
+        printf("No ROM given\n");
+        return 1;
+    }
+
+    //Without an explicit count every ROM runs once, otherwise the ROMs are assigned round robin
+    if (instances <= 0) instances = roms.size();
+
+    //Every instance replays the same movie, a recording is taken of the first instance
+    std::vector<std::unique_ptr<Movie>> movies;
+    if (playFile)
+    {
+        Movie movie;
+        if (!movie.read(playFile))
+        {
+            printf("Could not read movie %s\n", playFile);
+            return 1;
+        }
+        //Without --frames the whole movie is played
+        if (frames <= 0) frames = movie.frameCount();
+    }
+    if (frames <= 0) frames = 600;
+
+    //--threads 0 uses all hardware threads
+    BatchRunner runner(threads < 0 ? 1 : threads, quantum);
+
+    for (long instance = 0; instance < instances; instance++)
+    {
+        auto gameBoy = std::make_unique<GameBoy>(CartridgeBuilder::openROM(roms[instance % roms.size()]));
+        if (loadStateFile && !SaveState::read(*gameBoy, loadStateFile))
+        {
+            printf("Could not load state %s\n", loadStateFile);
+            return 1;
+        }
+        gameBoy->setRenderPolicy(renderPolicy, renderInterval);
+        gameBoy->setCpuBackend(cpuBackend);
+        if (runAhead > 0) gameBoy->setRunAhead(runAhead);
+
+        if (playFile)
+        {
+            movies.push_back(std::make_unique<Movie>());
+            if (!movies.back()->read(playFile) || !movies.back()->play(*gameBoy))
+            {
+                printf("Could not play movie %s on %s\n", playFile, roms[instance % roms.size()]);
+                return 1;
+            }
+        }
+        else if (recordFile && instance == 0)
+        {
+            movies.push_back(std::make_unique<Movie>());
+            movies.back()->record(*gameBoy);
+        }
+        runner.addInstance(std::move(gameBoy), frames);
+    }
+
+    double elapsed = runner.run();
+
+    if (dumpFile && !writeFrame(runner.instances()[0].gameBoy->ppu(), dumpFile))
+    {
+        printf("Could not write %s\n", dumpFile);
+        return 1;
+    }
+
+    if (saveStateFile && !SaveState::write(*runner.instances()[0].gameBoy, saveStateFile))
+    {
+        printf("Could not write %s\n", saveStateFile);
+        return 1;
+    }
+
+    if (recordFile && !movies[0]->write(recordFile))
+    {
+        printf("Could not write %s\n", recordFile);
+        return 1;
+    }
+
+    bool diverged = false;
+    if (playFile)
+    {
+        for (size_t index = 0; index < movies.size(); index++)
+        {
+            if (movies[index]->divergentFrame() == Movie::NO_DIVERGENCE) continue;
+            printf("instance %zu diverged from the movie at frame %llu\n", index, (unsigned long long)movies[index]->divergentFrame());
+            diverged = true;
+        }
+    }
+
+    for (size_t index = 0; index < runner.instances().size(); index++)
+    {
+        unsigned frames = runner.instances()[index].gameBoy->runAheadFrames();
+        if (frames != runAhead) printf("instance %zu fell back to %u frames of run-ahead\n", index, frames);
+    }
+
+    if (instances > 1)
+    {
+        for (size_t index = 0; index < runner.instances().size(); index++)
+        {
+            const BatchInstance& instance = runner.instances()[index];
+            printf("instance %zu (%s): %lu frames, %.1f frames/s\n", index, roms[index % roms.size()],
+                   (unsigned long)instance.framesDone, instance.framesDone / instance.busySeconds);
+        }
+    }
+
+    long totalFrames = frames * instances;
+    printf("%ld frames in %.3f s, %.1f frames/s (%ld instances, %u threads)\n",
+           totalFrames, elapsed, totalFrames / elapsed, instances, runner.threadCount());
+
+    return diverged ? 2 : 0;
+}
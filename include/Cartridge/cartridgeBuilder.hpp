@@ -18,13 +18,13 @@ public:
     {
         std::ifstream romFile;
 
-        romFile.open(fileName, ios::binary);
+        romFile.open(fileName, std::ios::binary);
 
         char controllerIdentifier = 0;
 
         romFile.seekg(0x147);
         romFile.read(&controllerIdentifier, 1);
-        romFile.seekg(0, std::ios::seekdir::beg);
+        romFile.seekg(0, std::ios::beg);
 
         std::unique_ptr<Peripheral> cartridge;
         switch(controllerIdentifier)
@@ -33,6 +33,7 @@ public:
             {
                 if (value != 0) value -= 1;
                 bankNRom.setOffset(ROM_BANK_SIZE * value);
+                remapped(ROM_BASE_ADDRESS_BANK_1, ROM_BANK_SIZE);
             }
         });
 
@@ -52,6 +53,12 @@ public:
         });
     }
 
+    void serialize(StateArchive& archive) override
+    {
+        Peripheral::serialize(archive);
+        if (archive.isLoading()) remapped(ROM_BASE_ADDRESS_BANK_1, ROM_BANK_SIZE);
+    }
+
 private:
 
     MemoryRange<ROM_BASE_ADDRESS_BANK_0, ROM_BANK_SIZE, true> bankZeroROM;
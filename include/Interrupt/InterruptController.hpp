@@ -3,6 +3,7 @@
 #include "./../Peripheral/peripheral.hpp"
 #include "./../Memory/register.hpp"
 #include <map>
+#include <functional>
 #include <assert.h> 
 
 #define INTERRUPT_ENABLE_ADDR 0xFFFF
@@ -29,11 +30,28 @@ public:
     {
         m_peripheralMemoryMap.insert(m_interruptEnable.toPair());
         m_peripheralMemoryMap.insert(m_interruptFlags.toPair());
+
+        m_interruptEnable.setOnWriteHandler([&](const uint16_t address, uint8_t& value){
+            changed();
+        });
+        m_interruptFlags.setOnWriteHandler([&](const uint16_t address, uint8_t& value){
+            changed();
+        });
+    }
+
+    /**
+     * @brief Called whenever an interrupt may have become pending: IME was set, a flag was
+     * raised or IE or IF was written. Until then hasPendingInterrupt() keeps its result.
+     */
+    void setOnChangeHandler(std::function<void()> handler)
+    {
+        m_onChangeHandler = handler;
     }
 
     inline void enableInterrupts()
     {
         m_masterInterruptEnabled = true;
+        changed();
     }
 
     inline void disableInterrupts()
@@ -44,6 +62,7 @@ public:
     inline void raiseInterrupt(InterruptFlags flags)
     {
         m_interruptFlags.value() |= (uint8_t) flags;
+        changed();
     }
 
     inline bool hasPendingInterrupt()
@@ -94,9 +113,21 @@ public:
         return 0x0;
     }
 
+    void serialize(StateArchive& archive) override
+    {
+        Peripheral::serialize(archive);
+        archive.value(m_masterInterruptEnabled);
+    }
+
 private:
 
+    inline void changed()
+    {
+        if (m_onChangeHandler) m_onChangeHandler();
+    }
+
     bool m_masterInterruptEnabled = false;
+    std::function<void()> m_onChangeHandler;
 
     Register<INTERRUPT_ENABLE_ADDR> m_interruptEnable;
     Register<INTERRUPT_FLAGS_ADDR> m_interruptFlags;
@@ -5,6 +5,8 @@
 #include <cassert>
 #include <functional>
 
+#include "../stateArchive.hpp"
+
 using MemoryReadHandler = std::function<void(const uint16_t& address)>;
 using MemoryWriteHandler = std::function<void(const uint16_t& address, uint8_t& value)>;
 
@@ -12,6 +14,8 @@ class Memory
 {
 
 public:
+    virtual ~Memory() = default;
+
     virtual uint8_t readMemory(uint16_t address) = 0;
 
     virtual void writeMemory(uint16_t address, uint8_t value) = 0;
@@ -20,6 +24,31 @@ public:
 
     virtual std::pair<uint16_t, Memory*> toPair() = 0;
 
+    /**
+     * @brief Pointer to the storage backing the address, if reading it has no side
+     * effects and the MemoryBus may bypass readMemory
+     * 
+     * @param address Address in the memory map
+     * @return uint8_t* host pointer or nullptr
+     */
+    virtual uint8_t* readPointer(uint16_t address) { return nullptr; }
+
+    /**
+     * @brief Pointer to the storage backing the address, if writing it has no side
+     * effects and the MemoryBus may bypass writeMemory
+     * 
+     * @param address Address in the memory map
+     * @return uint8_t* host pointer or nullptr
+     */
+    virtual uint8_t* writePointer(uint16_t address) { return nullptr; }
+
+    /**
+     * @brief Saves or loads the content, handlers are not called
+     * 
+     * @param archive Archive to copy the state into or out of
+     */
+    virtual void serialize(StateArchive& archive) = 0;
+
     void setOnReadHandler(MemoryReadHandler onReadHandler)
     {
         m_onReadHandler = onReadHandler;
@@ -10,7 +10,7 @@ class MemoryRange : public Memory
 
         virtual uint8_t readMemory(uint16_t absolutAddress) override
         {
-            uint16_t relativeAddress = (absolutAddress - t_startAddress) + m_offset;
+            uint32_t relativeAddress = (absolutAddress - t_startAddress) + m_offset;
             assert((relativeAddress) <= t_size);
             if (m_onReadHandler) { m_onReadHandler(absolutAddress); }
             return m_memory[relativeAddress];
@@ -21,11 +21,30 @@ class MemoryRange : public Memory
             if (m_onWriteHandler) { m_onWriteHandler(absolutAddress, value); }
             if constexpr(t_readOnly) return;
 
-            uint16_t relativeAddress = (absolutAddress - t_startAddress) + m_offset;
+            uint32_t relativeAddress = (absolutAddress - t_startAddress) + m_offset;
             assert(relativeAddress <= t_size);
             m_memory[relativeAddress] = value;
         }
 
+        virtual uint8_t* readPointer(uint16_t absolutAddress) override
+        {
+            if (m_onReadHandler) return nullptr;
+            return storagePointer(absolutAddress);
+        }
+
+        virtual uint8_t* writePointer(uint16_t absolutAddress) override
+        {
+            if (t_readOnly || m_onWriteHandler) return nullptr;
+            return storagePointer(absolutAddress);
+        }
+
+        virtual void serialize(StateArchive& archive) override
+        {
+            //ROM content never changes, only the selected bank does
+            if constexpr(!t_readOnly) archive.bytes(m_memory, t_size);
+            archive.value(m_offset);
+        }
+
         virtual std::vector<uint16_t> peripheralAddresses() override
         {
             return {t_startAddress};
@@ -46,6 +65,15 @@ class MemoryRange : public Memory
 
     protected:
 
-        uint8_t m_memory[t_size];
+        //The MemoryBus also asks for addresses this range does not cover while it is set up
+        uint8_t* storagePointer(uint16_t absolutAddress)
+        {
+            if (absolutAddress < t_startAddress) return nullptr;
+            uint32_t relativeAddress = (absolutAddress - t_startAddress) + m_offset;
+            if (relativeAddress >= (uint32_t)t_size) return nullptr;
+            return &m_memory[relativeAddress];
+        }
+
+        uint8_t m_memory[t_size] = {};
         uint32_t m_offset = 0;
 };
\ No newline at end of file
@@ -22,6 +22,11 @@ class Register : public Memory
             m_register = value;
         }
 
+        void serialize(StateArchive& archive)
+        {
+            archive.value(m_register);
+        }
+
         std::vector<uint16_t> peripheralAddresses()
         {
             return {t_registerAddress};
@@ -38,5 +43,5 @@ class Register : public Memory
         }
 
     private:
-        uint8_t m_register;
+        uint8_t m_register = 0;
 };
\ No newline at end of file
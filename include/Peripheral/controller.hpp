@@ -1,3 +1,5 @@
+#pragma once
+
 #include "peripheral.hpp"
 #include "Interrupt/InterruptSource.hpp"
 
@@ -66,6 +68,42 @@ public:
         m_buttons |= (1 << (uint8_t)button);
     }
 
+    /**
+     * @brief Buttons in the low and dpad in the high nibble, a cleared bit is a pressed key
+     */
+    uint8_t state() const
+    {
+        return (m_dpad << 4) | (m_buttons & 0x0F);
+    }
+
+    /**
+     * @brief Presses and releases keys until state() matches
+     */
+    void setState(uint8_t state)
+    {
+        for (uint8_t key = 0; key < 4; key++)
+        {
+            uint8_t mask = 1 << key;
+            if ((state & mask) != (m_buttons & mask))
+            {
+                if (state & mask) buttonReleased((Button)key);
+                else buttonPressed((Button)key);
+            }
+            if (((state >> 4) & mask) != (m_dpad & mask))
+            {
+                if ((state >> 4) & mask) dpadReleased((Dpad)key);
+                else dpadPressed((Dpad)key);
+            }
+        }
+    }
+
+    void serialize(StateArchive& archive) override
+    {
+        Peripheral::serialize(archive);
+        archive.value(m_buttons);
+        archive.value(m_dpad);
+    }
+
 private:
     Register<0xFF00> m_joypad;
     uint8_t m_buttons = 0xFF;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class PixelFormat : uint8_t
+{
+    RGB888,
+    RGBA8888,
+    RGB565,
+    GRAYSCALE
+};
+
+/**
+ * @brief Turns a frame of shades from 0 (white) to 3 (black) into pixels of an output
+ * format. The PPU only writes shades, the conversion runs when a consumer asks for it.
+ */
+class FrameConverter
+{
+
+public:
+
+    static size_t bytesPerPixel(PixelFormat format)
+    {
+        switch(format)
+        {
+            case PixelFormat::RGB888: return 3;
+            case PixelFormat::RGBA8888: return 4;
+            case PixelFormat::RGB565: return 2;
+            case PixelFormat::GRAYSCALE: return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @param shades Shades of the frame
+     * @param pixelCount Number of pixels to convert
+     * @param format Format of the destination
+     * @param destination Buffer of at least pixelCount * bytesPerPixel(format) bytes
+     */
+    static void convert(const uint8_t* shades, size_t pixelCount, PixelFormat format, void* destination);
+};
@@ -47,13 +47,11 @@ public:
         m_peripheralMemoryMap.insert(m_yCompareRegister.toPair());
     }
 
-    void updateStatus(PPUState state, uint8_t line)
+    /**
+     * @brief Raises the STAT interrupts the PPU entering the mode on the line triggers
+     */
+    void enterMode(PPUState state, uint8_t line)
     {
-        if (m_currentPPUState == state) return;
-        
-        m_statusRegister.value() &= 0b11111100;
-        m_statusRegister.value() |= (uint8_t)state;
-
         switch(state)
         {
             case PPUState::H_BLANK_MODE_0:
@@ -67,20 +65,60 @@ public:
                 break;
             case PPUState::LINE_RENDER_MODE_3: break;
         }
-        
-        if (m_yCompareRegister.value() == line)
+
+        if (lineCompareInterrupt(line)) raiseInterrupt();
+    }
+
+    /**
+     * @brief Puts the mode and the LY compare result into STAT, they are only stored when it is read
+     */
+    void updateStatus(PPUState state, uint8_t line)
+    {
+        m_statusRegister.value() &= ~(LY_COMPARE_BIT | 0b00000011);
+        m_statusRegister.value() |= (uint8_t)state;
+        if (m_yCompareRegister.value() == line) m_statusRegister.value() |= LY_COMPARE_BIT;
+    }
+
+    inline bool interruptEnabled(uint8_t source) { return m_statusRegister.value() & source; }
+
+    inline bool lineCompareInterrupt(uint8_t line) { return (m_statusRegister.value() & MODE_LYC_IE) && m_yCompareRegister.value() == line; }
+
+    void updateCurrentLine(uint8_t line);
+
+    void serialize(StateArchive& archive) override
+    {
+        Peripheral::serialize(archive);
+
+        //The first layout stored the mode of the last STAT update
+        if (archive.isLoading() && archive.version() == 0)
         {
-            if(m_statusRegister.value() & MODE_LYC_IE) raiseInterrupt();
-            m_statusRegister.value() |= LY_COMPARE_BIT;
+            PPUState mode;
+            archive.value(mode);
         }
-        else
+    }
+
+    /**
+     * @brief Sets the handlers for STAT reads and for changes of the STAT interrupt sources or LYC
+     */
+    void registerStatusHandlers(MemoryReadHandler readHandler, std::function<void()> changeHandler)
+    {
+        m_statusRegister.setOnReadHandler(readHandler);
+        m_statusRegister.setOnWriteHandler([this, changeHandler](const uint16_t address, uint8_t& value)
         {
-            m_statusRegister.value() &= ~LY_COMPARE_BIT;
-        }
-        m_currentPPUState = state;
-        
-    }      
-    void updateCurrentLine(uint8_t line);
+            m_statusRegister.value() = value;
+            changeHandler();
+        });
+        m_yCompareRegister.setOnWriteHandler([this, changeHandler](const uint16_t address, uint8_t& value)
+        {
+            m_yCompareRegister.value() = value;
+            changeHandler();
+        });
+    }
+
+    void registerControlHandler(MemoryWriteHandler handler)
+    {
+        m_controlRegister.setOnWriteHandler(handler);
+    }
     
     inline bool ppuEnabled() { return m_controlRegister.value() & PPU_ENABLE_FLAG; }
 
@@ -100,8 +138,6 @@ public:
 
 private:
 
-    PPUState m_currentPPUState;
-
     Register<LCDC_STATUS_ADDRESS> m_statusRegister;
     Register<LCDC_CONTROL_ADDRESS> m_controlRegister;
     Register<LCD_Y_COMP_ADDRESS> m_yCompareRegister;
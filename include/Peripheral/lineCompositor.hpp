@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define LINE_WIDTH 160
+
+//Layout of a pixel in the object line, 0 is a transparent pixel
+#define OBJECT_COLOR_MASK   0b00000011
+#define OBJECT_PALETTE_1    0b00000100
+#define OBJECT_BEHIND_BG    0b00001000
+
+/**
+ * @brief Palettes in use for a line as shades from 0 (white) to 3 (black),
+ * index 0-3 is BGP, 4-7 OBP0 and 8-11 OBP1
+ */
+struct LinePalettes
+{
+    uint8_t shades[16];
+};
+
+/**
+ * @brief Merges the background and object color indices of a line and applies the
+ * palettes. Uses AVX2, SSSE3 or SSE2 depending on the host CPU, with a scalar fallback
+ * on other architectures.
+ */
+class LineCompositor
+{
+
+public:
+
+    using ComposeFunction = void (*)(const uint8_t*, const uint8_t*, const LinePalettes&, uint8_t*);
+
+    struct Implementation
+    {
+        const char* name;
+        ComposeFunction compose;
+    };
+
+    /**
+     * @param background Background/window color indices, LINE_WIDTH entries
+     * @param objects Object pixels in the OBJECT_* layout, LINE_WIDTH entries
+     * @param palettes Shades of BGP, OBP0 and OBP1
+     * @param shades Output, LINE_WIDTH shades
+     */
+    static void compose(const uint8_t* background, const uint8_t* objects, const LinePalettes& palettes, uint8_t* shades)
+    {
+        static const ComposeFunction composeFunction = selectImplementation();
+        composeFunction(background, objects, palettes, shades);
+    }
+
+    /**
+     * @brief Same result as compose() one pixel at a time, used when no vector unit is available
+     */
+    static void composeScalar(const uint8_t* background, const uint8_t* objects, const LinePalettes& palettes, uint8_t* shades);
+
+    static const char* implementationName();
+
+    /**
+     * @brief All implementations the host CPU supports, the one compose() uses first
+     */
+    static std::vector<Implementation> implementations();
+
+private:
+
+    static ComposeFunction selectImplementation();
+};
@@ -5,11 +5,16 @@
 #include <stdint.h>
 #include <vector>
 #include <map>
+#include <functional>
+
+using RemapHandler = std::function<void(uint16_t address, uint32_t size)>;
 
 class Peripheral
 {
 public:
 
+    virtual ~Peripheral() = default;
+
     virtual uint8_t readFromPeripheral(uint16_t address)
     {
         auto peripheralItr = m_peripheralMemoryMap.upper_bound(address);
@@ -24,6 +29,22 @@ public:
         peripheralItr->second->writeMemory(address, value);
     }
 
+    /**
+     * @brief Returns the Memory that serves the address, so the MemoryBus can
+     * dispatch to it without going through the Peripheral. Peripherals that need
+     * to intercept accesses return nullptr.
+     * 
+     * @param address Address in the memory map
+     * @return Memory* memory mapped at the address or nullptr
+     */
+    virtual Memory* memoryForAddress(uint16_t address)
+    {
+        auto peripheralItr = m_peripheralMemoryMap.upper_bound(address);
+        if (peripheralItr == m_peripheralMemoryMap.begin()) return nullptr;
+        peripheralItr--;
+        return peripheralItr->second;
+    }
+
     virtual std::vector<uint16_t> peripheralAddresses()
     {
         std::vector<uint16_t> addressVector;
@@ -34,8 +55,40 @@ public:
         return addressVector;
     }
 
+    /**
+     * @brief Saves or loads the state of all mapped memory, peripherals with
+     * additional state extend this
+     * 
+     * @param archive Archive to copy the state into or out of
+     */
+    virtual void serialize(StateArchive& archive)
+    {
+        for (auto& memory : m_peripheralMemoryMap)
+        {
+            memory.second->serialize(archive);
+        }
+    }
+
+    void setOnRemapHandler(RemapHandler onRemapHandler)
+    {
+        m_onRemapHandler = onRemapHandler;
+    }
+
 protected:
 
+    /**
+     * @brief Tells the MemoryBus that the storage behind an address range moved,
+     * e.g. after a bank switch, so it can update its cached pointers
+     * 
+     * @param address Start address of the range
+     * @param size Size of the range
+     */
+    void remapped(uint16_t address, uint32_t size)
+    {
+        if (m_onRemapHandler) m_onRemapHandler(address, size);
+    }
+
     std::map<uint16_t, Memory*> m_peripheralMemoryMap;
+    RemapHandler m_onRemapHandler = nullptr;
 
 };
\ No newline at end of file
@@ -5,9 +5,12 @@
 #include "../Interrupt/InterruptSource.hpp"
 #include "../Memory/memoryRange.hpp"
 #include "../Memory/register.hpp"
+#include "../scheduler.hpp"
+#include "frameConverter.hpp"
 
 #include <map>
 #include <array>
+#include <functional>
 #include <span>
 
 #define OAM_SIZE 160
@@ -25,6 +28,11 @@
 
 #define V_BLANK_BOUND 154
 
+//Cycles into a line at which H-Blank starts and the line is drawn
+#define H_BLANK_START (OAM_CYCLES + LINE_RENDER_CYCLES)
+
+#define FRAME_CYCLES (V_BLANK_BOUND * CYCLES_PER_LINE)
+
 #define OAM_ADDRESS 0xFE00
 #define VRAM_ADDRESS 0x8000
 
@@ -40,6 +48,15 @@
 
 #define SPRITE_LIMIT 10
 
+//OAM positions are offset, so sprites can be partly above or left of the screen
+#define SPRITE_Y_OFFSET 16
+#define SPRITE_X_OFFSET 8
+
+//Tile data at 0x8000-0x97FF, 384 tiles of 8x8 pixels with 2 bytes per row
+#define TILE_DATA_SIZE 0x1800
+#define TILE_COUNT 384
+#define TILE_SIZE 16
+
 namespace
 {
     class Sprite
@@ -48,36 +65,102 @@ namespace
     static constexpr uint8_t verticalFlip = 0b01000000;
     static constexpr uint8_t horizontalFlip = 0b00100000;
     static constexpr uint8_t bgWindowOverObj = 0b10000000;
+    static constexpr uint8_t palette1 = 0b00010000;
     
     public:
+        //As in OAM, SPRITE_Y_OFFSET and SPRITE_X_OFFSET below and right of the screen position
         uint8_t yPosition;
         uint8_t xPosition;
         uint8_t tilePointer;
         uint8_t attributes;
     
-        bool isVerticalFlipped() { return attributes & verticalFlip; }
-        bool isHorizontalFlipped() { return attributes & horizontalFlip; }
-        bool isAboveBgWindow() {return attributes & bgWindowOverObj; }
+        bool isVerticalFlipped() const { return attributes & verticalFlip; }
+        bool isHorizontalFlipped() const { return attributes & horizontalFlip; }
+        bool isBehindBgWindow() const { return attributes & bgWindowOverObj; }
+        bool usesPalette1() const { return attributes & palette1; }
     };
 }
 
+/**
+ * @brief Which frames are drawn, skipped frames keep their timing and interrupts
+ * but leave the frame buffer untouched
+ */
+enum class RenderPolicy : uint8_t
+{
+    ALL,
+    EVERY_NTH,
+    ON_DEMAND,
+    NEVER
+};
+
 class PictureProcessingUnit : public Peripheral, public InterruptSource
 { 
 
 public:
-    PictureProcessingUnit(InterruptController& interruptController, LcdcStatus& lcdcStatus);
+    PictureProcessingUnit(InterruptController& interruptController, LcdcStatus& lcdcStatus, Scheduler& scheduler);
 
     uint8_t readFromPeripheral(uint16_t address);
 
     void writeToPeripheral(uint16_t address, uint8_t value);
 
+    Memory* memoryForAddress(uint16_t address);
+
     void registerDmaHandler(MemoryWriteHandler handler);
 
-    void tick(uint8_t cycles);
+    void serialize(StateArchive& archive) override;
 
     auto& objectAttributeMemory() { return m_oam; }
-    ///uint8_t m_frameBuffer[V_RES][H_RES];
-    uint8_t screenData[V_RES][H_RES][3];
+
+    /**
+     * @brief Converts the current frame for display
+     * 
+     * @param format Format of the destination
+     * @param destination Buffer of V_RES * H_RES * FrameConverter::bytesPerPixel(format) bytes
+     */
+    void convertFrame(PixelFormat format, void* destination);
+
+    /**
+     * @brief Sets which frames are drawn, takes effect with the next frame
+     * 
+     * @param policy Render policy
+     * @param interval Draw every interval-th frame with RenderPolicy::EVERY_NTH
+     */
+    void setRenderPolicy(RenderPolicy policy, unsigned interval = 1);
+
+    /**
+     * @brief Called when the last line of a drawn frame is done. frameBuffer then holds
+     * the whole frame until the first line of the next drawn frame.
+     */
+    void setFrameCompleteHandler(std::function<void()> handler) { m_frameCompleteHandler = handler; }
+
+    /**
+     * @brief Draws the next frame with RenderPolicy::ON_DEMAND
+     */
+    void requestFrame() { m_frameRequested = true; }
+
+    //Which frames are drawn and whether the current one is, not part of the machine state
+    struct RenderState
+    {
+        RenderPolicy policy;
+        unsigned interval;
+        unsigned framesSinceRender;
+        bool frameRequested;
+        bool renderFrame;
+    };
+
+    RenderState renderState() const
+    {
+        return { m_renderPolicy, m_renderInterval, m_framesSinceRender, m_frameRequested, m_renderFrame };
+    }
+
+    /**
+     * @brief Puts back a render state taken before, unlike setRenderPolicy() this also
+     * decides about the current frame
+     */
+    void setRenderState(const RenderState& state);
+
+    //Shades from 0 (white) to 3 (black) with the palettes applied
+    uint8_t frameBuffer[V_RES][H_RES] = {};
 
 private:
 
@@ -88,16 +171,37 @@ private:
         return std::make_pair(memory->first, memory->second);
     }
 
+    static PPUState modeAt(uint32_t position);
+    static uint32_t nextModeChange(uint32_t position);
+
+    //Cycles since line 0 of the current frame started, only valid while the LCD is on
+    inline uint32_t framePosition() { return m_scheduler.get().now() - m_frameStart; }
+    PPUState currentMode();
+    uint8_t currentLine();
+
+    void modeTransition(uint64_t timestamp);
+    void scheduleTransition(uint32_t position);
+    void scheduleDraw(uint32_t position);
+    void scheduleReadChange(uint32_t position);
+    void beginFrame();
+    void switchDisplay(bool enable);
+
     void drawLine(uint8_t line);
-    void drawBackground(uint8_t line);
-    void drawWindow(uint8_t line);
-    void drawSprites(uint8_t line);
+    void drawBackground(uint8_t line, uint8_t* colors);
+    void drawWindow(uint8_t line, uint8_t* colors);
+    void drawSprites(uint8_t line, uint8_t* objects);
+    void applyPalette(uint8_t palette, uint8_t* shades);
     void searchSprites(uint8_t line);
     void renderPixel(uint8_t xPos, uint8_t yPos, uint8_t pixel);
 
+    void decodeDirtyTiles();
+    const uint8_t* backgroundTileRow(int tileMapAddress, int tileRow);
+
     std::reference_wrapper<LcdcStatus> m_lcdcStatus;
+    std::reference_wrapper<Scheduler> m_scheduler;
 
-    uint8_t m_spritesInLine;
+    //Sprites of the line being drawn, searched right before it
+    uint8_t m_spritesInLine = 0;
     std::array<Sprite, SPRITE_LIMIT> m_sprites;
 
     Register<LCD_SCY_ADDRESS> m_scrollY;
@@ -125,6 +229,18 @@ private:
     Register<0xFF69> m_cgbDunno;
     Register<0xFF4F> m_cgbVRAM;
 
-    PPUState m_currentMode = PPUState::OAM_SEARCH_MODE_2;
-    uint16_t m_currentCycle = 0;
+    //LY, STAT and the mode follow from the cycles since this one
+    uint64_t m_frameStart = 0;
+
+    RenderPolicy m_renderPolicy = RenderPolicy::ALL;
+    unsigned m_renderInterval = 1;
+    unsigned m_framesSinceRender = 0;
+    bool m_frameRequested = false;
+    bool m_renderFrame = true;
+    std::function<void()> m_frameCompleteHandler;
+
+    //Tiles decoded to one 2 bit color index per pixel, re-decoded when their VRAM bytes were written
+    uint8_t m_tileCache[TILE_COUNT][8][8] = {};
+    std::array<uint64_t, TILE_COUNT / 64> m_dirtyTiles;
+    bool m_hasDirtyTiles = true;
 };
\ No newline at end of file
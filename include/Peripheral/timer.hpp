@@ -2,6 +2,7 @@
 
 #include "peripheral.hpp"
 #include "../Memory/register.hpp"
+#include "../scheduler.hpp"
 
 
 #define TIMER_ENABLE (1 << 2)
@@ -11,46 +12,68 @@
 #define CLOCK_DIV_64   0b00000010
 #define CLOCK_DIV_16   0b00000001
 
+//DIV counts at 16384 Hz
+#define DIVIDER_CYCLES 256
+
 class Timer : public Peripheral, public InterruptSource
 {
 public:
-    Timer(InterruptController& interruptController) : InterruptSource(interruptController, InterruptFlags::TIMER_FLAG)
+    Timer(InterruptController& interruptController, Scheduler& scheduler) : 
+        InterruptSource(interruptController, InterruptFlags::TIMER_FLAG), m_scheduler(scheduler)
     {
         m_peripheralMemoryMap.insert(m_divider.toPair());
         m_peripheralMemoryMap.insert(m_counter.toPair());
         m_peripheralMemoryMap.insert(m_modulo.toPair());
         m_peripheralMemoryMap.insert(m_control.toPair());
 
+        m_scheduler.get().setEventHandler(SchedulerEvent::TIMER_OVERFLOW, [&](uint64_t timestamp)
+        {
+            overflow(timestamp);
+        });
+
+        //DIV and TIMA are derived from the emulated time when they are accessed
+        m_divider.setOnReadHandler([&](const uint16_t& address)
+        {
+            m_scheduler.get().markChange();
+            m_divider.value() = (m_scheduler.get().now() - m_dividerTimestamp) / DIVIDER_CYCLES;
+        });
+
         m_divider.setOnWriteHandler([&](const uint16_t address, uint8_t& value)
         {
+            m_dividerTimestamp = m_scheduler.get().now();
             value = 0x00;
         });
 
+        m_counter.setOnReadHandler([&](const uint16_t& address)
+        {
+            m_scheduler.get().markChange();
+            syncCounter();
+        });
+
+        m_counter.setOnWriteHandler([&](const uint16_t address, uint8_t& value)
+        {
+            syncCounter();
+            m_counter.value() = value;
+            scheduleOverflow();
+        });
+
         m_control.setOnWriteHandler([&](const uint16_t address, uint8_t& value)
         {
+            syncCounter();
+            if (!isEnabled()) m_counterTimestamp = m_scheduler.get().now();
+            m_control.value() = value;
             m_currentDivider = clockDivider(value);
+            scheduleOverflow();
         });
 
     }
 
-    void step(uint8_t cycle)
+    void serialize(StateArchive& archive) override
     {
-        m_dividerCycle += cycle;
-        m_divider.value() += m_dividerCycle / 1024;
-        if (m_dividerCycle >= 1024) m_dividerCycle = 0;
-
-        if (isEnabled()) 
-        {
-            m_counterCycle += cycle;
-            uint8_t timerDelta = m_counterCycle / m_currentDivider;
-            m_counter.value() += timerDelta;
-            if (m_counter.value() == 0 && timerDelta)
-            {
-                raiseInterrupt();
-                m_counter.value() = m_modulo.value();
-            }
-            if (m_counterCycle >= m_currentDivider) m_counterCycle = 0;
-        }
+        Peripheral::serialize(archive);
+        archive.value(m_currentDivider);
+        archive.value(m_counterTimestamp);
+        archive.value(m_dividerTimestamp);
     }
 
 private:
@@ -68,10 +91,44 @@ private:
         }
         return 0;
     }
-    
+
+    /**
+     * @brief Applies the counter increments since the last sync to TIMA
+     */
+    void syncCounter()
+    {
+        if (!isEnabled()) return;
+
+        uint64_t ticks = (m_scheduler.get().now() - m_counterTimestamp) / m_currentDivider;
+        m_counter.value() += ticks;
+        m_counterTimestamp += ticks * m_currentDivider;
+    }
+
+    void scheduleOverflow()
+    {
+        if (!isEnabled())
+        {
+            m_scheduler.get().cancel(SchedulerEvent::TIMER_OVERFLOW);
+            return;
+        }
+
+        uint64_t ticksToOverflow = 0x100 - m_counter.value();
+        m_scheduler.get().schedule(SchedulerEvent::TIMER_OVERFLOW, m_counterTimestamp + ticksToOverflow * m_currentDivider);
+    }
+
+    void overflow(uint64_t timestamp)
+    {
+        m_counter.value() = m_modulo.value();
+        m_counterTimestamp = timestamp;
+        raiseInterrupt();
+        scheduleOverflow();
+    }
+
+    std::reference_wrapper<Scheduler> m_scheduler;
+
     uint16_t m_currentDivider = 1024;
-    uint16_t m_counterCycle = 0;
-    uint16_t m_dividerCycle = 0;
+    uint64_t m_counterTimestamp = 0;
+    uint64_t m_dividerTimestamp = 0;
 
     Register<0xFF04> m_divider;
     Register<0xFF05> m_counter;
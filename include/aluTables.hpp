@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "statusRegister.hpp"
+
+/**
+ * @brief Flags of the 8-bit arithmetic and the result of DAA, precomputed by the compiler.
+ * Used with GBEMU_ALU_TABLES, nothing is generated or loaded at runtime.
+ */
+namespace AluTables
+{
+    /**
+     * @brief Index into ADD_FLAGS and SUB_FLAGS. The flags of an addition or subtraction
+     * only depend on the 9 bit result, whose bit 8 is the carry or borrow, and on bit 4 of
+     * operandA ^ operandB ^ result, the carry into bit 4. So 1K entries cover every operand
+     * and carry combination of ADD, ADC, SUB, SBC and CP.
+     */
+    constexpr uint32_t flagIndex(uint8_t operandA, uint8_t operandB, uint16_t result)
+    {
+        return (((operandA ^ operandB ^ result) & 0x10) << 5) | (result & 0x1FF);
+    }
+
+    constexpr uint8_t zeroFlag(uint8_t result)
+    {
+        return result == 0 ? RegisterFlag::ZERO_FLAG : 0;
+    }
+
+    constexpr std::array<uint8_t, 1024> makeArithmeticFlags(uint8_t subFlag)
+    {
+        std::array<uint8_t, 1024> table = {};
+        for (uint32_t index = 0; index < 1024; index++)
+        {
+            table[index] = zeroFlag(index & 0xFF) | subFlag
+                | (index & 0x200 ? RegisterFlag::HALF_CARRY_FLAG : 0)
+                | (index & 0x100 ? RegisterFlag::CARRY_FLAG : 0);
+        }
+        return table;
+    }
+
+    //Without the carry, INC and DEC keep it
+    constexpr std::array<uint8_t, 256> makeIncFlags()
+    {
+        std::array<uint8_t, 256> table = {};
+        for (uint32_t a = 0; a < 256; a++)
+        {
+            table[a] = zeroFlag((a + 1) & 0xFF) | ((a & 0x0F) == 0x0F ? RegisterFlag::HALF_CARRY_FLAG : 0);
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> makeDecFlags()
+    {
+        std::array<uint8_t, 256> table = {};
+        for (uint32_t a = 0; a < 256; a++)
+        {
+            table[a] = zeroFlag((a - 1) & 0xFF) | RegisterFlag::SUB_FLAG | ((a & 0x0F) == 0 ? RegisterFlag::HALF_CARRY_FLAG : 0);
+        }
+        return table;
+    }
+
+    //Index is N, H and C in bits 10-8 and A in bits 7-0, entry is A in the low and the flags in the high byte
+    constexpr std::array<uint16_t, 8 * 256> makeDaaTable()
+    {
+        std::array<uint16_t, 8 * 256> table = {};
+        for (uint32_t flags = 0; flags < 8; flags++)
+        {
+            bool negative = flags & 0x4;
+            bool halfCarry = flags & 0x2;
+            bool carry = flags & 0x1;
+
+            for (uint32_t a = 0; a < 256; a++)
+            {
+                uint8_t result = a;
+                if (!negative)
+                {
+                    if (carry || result > 0x99)
+                    {
+                        result += 0x60;
+                        carry = true;
+                    }
+                    if (halfCarry || (result & 0x0F) > 0x09) result += 0x06;
+                }
+                else
+                {
+                    if (carry) result -= 0x60;
+                    if (halfCarry) result -= 0x06;
+                }
+
+                uint8_t resultFlags = zeroFlag(result) | (negative ? RegisterFlag::SUB_FLAG : 0) | (carry ? RegisterFlag::CARRY_FLAG : 0);
+                table[(flags << 8) | a] = ((uint16_t)resultFlags << 8) | result;
+                carry = flags & 0x1;
+            }
+        }
+        return table;
+    }
+
+    inline constexpr std::array<uint8_t, 1024> ADD_FLAGS = makeArithmeticFlags(0);
+    inline constexpr std::array<uint8_t, 1024> SUB_FLAGS = makeArithmeticFlags(RegisterFlag::SUB_FLAG);
+    inline constexpr std::array<uint8_t, 256> INC_FLAGS = makeIncFlags();
+    inline constexpr std::array<uint8_t, 256> DEC_FLAGS = makeDecFlags();
+    inline constexpr std::array<uint16_t, 8 * 256> DAA_TABLE = makeDaaTable();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "gameBoy.hpp"
+
+struct BatchInstance
+{
+    std::unique_ptr<GameBoy> gameBoy;
+    uint64_t frames = 0;
+    uint64_t framesDone = 0;
+    double busySeconds = 0;
+};
+
+/**
+ * @brief Runs many GameBoy instances on a pool of worker threads. Each worker owns a deque
+ * of instance indices, runs the instance at its back for one quantum of frames and pushes it
+ * back while it has frames left. Idle workers steal from the front of the other deques, so
+ * slow and fast instances even out without any static partitioning.
+ */
+class BatchRunner
+{
+public:
+
+    /**
+     * @param threadCount Number of workers, 0 uses one per hardware thread
+     * @param framesPerQuantum Frames an instance runs before it can be stolen
+     */
+    explicit BatchRunner(unsigned threadCount = 0, unsigned framesPerQuantum = 1);
+
+    void addInstance(std::unique_ptr<GameBoy> gameBoy, uint64_t frames);
+
+    /**
+     * @brief Runs all instances until each of them reached its frame count
+     *
+     * @return Wall clock seconds of the whole batch
+     */
+    double run();
+
+    inline unsigned threadCount() const { return m_threadCount; }
+
+    inline const std::vector<BatchInstance>& instances() const { return m_instances; }
+
+private:
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<size_t> indices;
+    };
+
+    void worker(unsigned id);
+
+    bool popLocal(unsigned id, size_t& index);
+
+    bool steal(unsigned id, size_t& index);
+
+    unsigned m_threadCount;
+    unsigned m_framesPerQuantum;
+
+    std::vector<BatchInstance> m_instances;
+    std::unique_ptr<WorkQueue[]> m_queues;
+    std::atomic<size_t> m_pending{0};
+};
@@ -1,15 +1,36 @@
 #pragma once 
 #include <span>
 #include <map>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "instruction.hpp"
 #include "statusRegister.hpp"
 #include "Peripheral/peripheral.hpp"
 #include "Interrupt/InterruptController.hpp"
 #include "memoryBus.hpp"
+#include "scheduler.hpp"
+
+#ifdef GBEMU_JIT
+    #include "jitCompiler.hpp"
+#endif
 
 using namespace std;
 
+//Decoding stops after this many instructions, the rest of a long block is decoded when it is reached
+#define BLOCK_MAX_INSTRUCTIONS 64
+//Entries of the direct mapped lookup in front of the block map
+#define BLOCK_LOOKUP_SIZE 256
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define GBEMU_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+    #define GBEMU_ALWAYS_INLINE inline
+#endif
+
 namespace
 {
     struct GeneralRegister
@@ -72,24 +93,209 @@ namespace
 }
 
 
+/**
+ * @brief How the CPU gets to the instruction at the program counter, both run the same
+ * instruction code and can be switched between any two steps
+ */
+enum class CpuBackend
+{
+    //Reads and decodes every instruction through the bus
+    INTERPRETER,
+    //Replays blocks of instructions decoded once, code in RAM is decoded again after writes
+    DECODED_BLOCKS,
+#ifdef GBEMU_JIT
+    //Runs blocks from read only memory as x86-64 code, everything else like DECODED_BLOCKS
+    JIT
+#endif
+};
+
 class Cpu
 {
 public:
 
-    Cpu(InterruptController& interruptController, MemoryBus& memoryBus) : 
-        m_interruptController(&interruptController), m_memoryMap(&memoryBus), statusRegister(gpRegister.registerF)
-    { }
-
+    Cpu(InterruptController& interruptController, MemoryBus& memoryBus, Scheduler& scheduler) : 
+        m_interruptController(&interruptController), m_memoryMap(&memoryBus), m_scheduler(scheduler), statusRegister(gpRegister.registerF)
+    {
+        memoryBus.setOnCodeWriteHandler([&](uint16_t address){
+            invalidateCode(address);
+        });
+        //The blocks stay valid for their storage, but the rest of the current one may be gone.
+        //A compiled block checks for this after its writes.
+        memoryBus.setOnMappingChangeHandler([&](){
+            m_blockNext = m_blockEnd = nullptr;
+        });
+        interruptController.setOnChangeHandler([&](){
+            m_runLimit = 0;
+        });
+    }
+
+    /**
+     * @brief Executes instructions until the scheduler reaches the deadline. The scheduler
+     * advances after every instruction, so peripherals and interrupts see the exact cycles.
+     * Interrupts are only checked after something may have made one pending. Idle loops
+     * and HALT are skipped up to the next event or the deadline.
+     *
+     * @param deadline Absolute cycle, the last instruction may end after it
+     * @return Cycles that passed
+     */
+    uint64_t runUntil(uint64_t deadline);
+
+    /**
+     * @brief Like runUntil(), with a deadline relative to the current cycle
+     */
+    uint64_t run(uint64_t cycleBudget) { return runUntil(m_scheduler.get().now() + cycleBudget); }
+
+    /**
+     * @brief Executes a single instruction without advancing the scheduler
+     *
+     * @return Cycles the instruction took
+     */
     uint8_t step();
 
+    void serialize(StateArchive& archive);
+
+    /**
+     * @brief Switches the backend between two steps, JIT falls back to DECODED_BLOCKS if no
+     * executable memory can be mapped
+     */
+    void setBackend(CpuBackend backend);
+
+    inline CpuBackend backend() const { return m_backend; }
+
+    /**
+     * @brief Cycles of one iteration if the last step entered a loop that repeats itself
+     * exactly: it has no side effects and the registers came back unchanged after the last
+     * iteration. Until something the loop reads changes, every further iteration is the
+     * same and can be skipped. 0 otherwise, loops are only detected with DECODED_BLOCKS and JIT.
+     * While halted every step is such an iteration of 1 cycle.
+     */
+    inline uint32_t idleLoopCycles() const { return m_idleLoopCycles; }
+
+    inline bool isHalted() const { return m_isHalted; }
+
 private:
 
+    /**
+     * @brief Skips iterations of the idle loop or the cycles of a HALT, up to the next event
+     * or the deadline, so the machine ends up exactly where running them would have left it
+     */
+    void skipIdleLoop(uint64_t deadline);
+
+    //Body of step()
+    uint8_t stepInstruction();
+
+    //Wakes the CPU on a raised interrupt, true while it stays halted
+    bool checkHalt();
+
+    //Fetches and executes the next instruction, without HALT and interrupt handling
+    template<CpuBackend t_backend> uint8_t executeInstruction();
+
+    /**
+     * @brief Executes instructions and advances the scheduler until an instruction would
+     * reach m_runLimit. That one is executed but its cycles are returned, not advanced, so
+     * its interrupt check still comes before the time moves on.
+     */
+    template<CpuBackend t_backend> uint8_t runInstructions();
+
+    //Calls the pending interrupt after an instruction, returns the cycles this took
+    uint8_t serviceInterrupt();
+
+    //Instructions decoded once, starting at a host pointer and ending at a jump or the end of the page
+    struct CodeBlock
+    {
+        std::vector<Instructions::Instruction> instructions;
+        //Leading instructions that neither write memory nor touch the stack, IME or HALT
+        size_t sideEffectFree = 0;
+#ifdef GBEMU_JIT
+        //Only code that can not be written is compiled
+        bool readOnly = false;
+        JitBlock compiled;
+#endif
+    };
+
+    /**
+     * @brief Takes the current instruction from the block being executed
+     *
+     * @return false if the program counter left the block or it has no instructions left
+     */
+    bool continueBlock();
+
+    /**
+     * @brief Looks up or decodes the block at the program counter and makes it the one
+     * being executed
+     *
+     * @return nullptr if the code at the program counter can not be kept decoded
+     */
+    CodeBlock* enterBlock();
+
+    CodeBlock& decodeBlock(const uint8_t* code);
+
+#ifdef GBEMU_JIT
+    /**
+     * @brief Compiles the block on its first entry. True if it can run as a whole now: no
+     * event and no interrupt check falls before its last instruction.
+     */
+    bool canRunCompiled(CodeBlock& block);
+
+    /**
+     * @brief Runs the compiled block just entered and advances the scheduler up to the
+     * last instruction that ran, like runInstructions() would have
+     *
+     * @return Cycles of that last instruction
+     */
+    uint8_t runCompiled(const CodeBlock& block);
+
+    //Memory handlers of the compiled code, they bring the time up to the accessing instruction
+    static uint8_t compiledRead(void* context, uint16_t address, uint32_t cycles);
+    static void compiledWrite(void* context, uint16_t address, uint8_t value, uint32_t cycles);
+    void syncCompiled(uint32_t cycles);
+    void checkCompiledExit();
+#endif
+
+    /**
+     * @brief Called when a block is entered, checks whether the last block was the same
+     * one and ran once around a loop back to its start
+     */
+    void detectIdleLoop(const CodeBlock& block);
+
+    static inline size_t blockLookupIndex(const uint8_t* code)
+    {
+        return (uintptr_t)code % BLOCK_LOOKUP_SIZE;
+    }
+
+    /**
+     * @brief Drops the blocks decoded from the page of a written address
+     */
+    void invalidateCode(uint16_t address);
+
+    /**
+     * @brief Drops every block decoded from writable memory, its content may have
+     * changed without a write on the bus
+     */
+    void invalidateWritableCode();
+
     void fetch();
 
     void decode();
 
     void execute();
 
+    void executeOperation(uint16_t operation);
+
+#ifdef GBEMU_DISPATCH_TABLE
+    //One handler per opcode, so every opcode gets its own indirect branch
+    using OperationTable = std::array<void (Cpu::*)(), 256>;
+
+    template<uint16_t t_operation>
+    void operationHandler();
+
+    template<uint16_t t_prefix, size_t... t_opCodes>
+    static constexpr OperationTable makeOperationTable(std::index_sequence<t_opCodes...>);
+
+    static const OperationTable s_operationTable;
+    static const OperationTable s_cbOperationTable;
+#endif
+
     void add8Bit(uint8_t operant);
 
     void add16Bit(uint16_t operant);
@@ -152,12 +358,52 @@ private:
 
 
     MemoryBus* m_memoryMap;
+    std::reference_wrapper<Scheduler> m_scheduler;
     GeneralRegister gpRegister;
     InterruptController* m_interruptController;
     StatusRegister statusRegister;
-    uint16_t stackPointer;
-    uint16_t programmCounter;
-    uint16_t currentOpCode;
-    Instructions::Instruction currentInstruction;
+    uint16_t stackPointer = 0;
+    uint16_t programmCounter = 0;
+    uint16_t currentOpCode = 0;
+    Instructions::Instruction currentInstruction = {};
     bool m_isHalted = false;
+
+    CpuBackend m_backend = CpuBackend::DECODED_BLOCKS;
+    //Keyed by the host pointer of the first instruction, which tells ROM banks apart
+    std::unordered_map<const uint8_t*, CodeBlock> m_blocks;
+    //Loops enter the same few blocks over and over, so most entries skip the hashing
+    struct BlockLookup
+    {
+        const uint8_t* code = nullptr;
+        CodeBlock* block = nullptr;
+    };
+    std::array<BlockLookup, BLOCK_LOOKUP_SIZE> m_blockLookup;
+    //Blocks decoded from each watched page
+    std::array<std::vector<const uint8_t*>, PAGE_COUNT> m_writableBlocks;
+    //Rest of the block being executed and the address it continues at
+    const Instructions::Instruction* m_blockNext = nullptr;
+    const Instructions::Instruction* m_blockEnd = nullptr;
+    uint16_t m_blockAddress = 0;
+
+    //Block entered last and the registers at that point, only taken when the block looped
+    const CodeBlock* m_block = nullptr;
+    uint16_t m_blockStart = 0;
+    bool m_hasBlockRegisters = false;
+    uint8_t m_blockRegisters[sizeof(GeneralRegister)] = {};
+    uint16_t m_blockStackPointer = 0;
+    uint32_t m_idleLoopCycles = 0;
+
+    //runUntil() executes instructions without checking for HALT, interrupts and idle loops
+    //until this cycle. Anything that needs the checks sets it to 0.
+    uint64_t m_runLimit = 0;
+
+#ifdef GBEMU_JIT
+    //Created on the first switch to the JIT backend
+    std::unique_ptr<JitCompiler> m_jit;
+    //Cycle at which the last instruction of the running compiled block starts
+    uint64_t m_jitLimit = 0;
+    //Cycles of the running compiled block the scheduler was advanced by
+    uint32_t m_jitAdvanced = 0;
+    bool m_jitExit = false;
+#endif
 };
\ No newline at end of file
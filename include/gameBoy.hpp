@@ -0,0 +1,216 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cpu.hpp"
+#include "scheduler.hpp"
+#include "inputQueue.hpp"
+#include "memoryBus.hpp"
+#include "Interrupt/InterruptController.hpp"
+#include "Peripheral/ppu.hpp"
+#include "Peripheral/lcdcStatus.hpp"
+#include "Peripheral/soundController.hpp"
+#include "Peripheral/socRAM.hpp"
+#include "Peripheral/timer.hpp"
+#include "Peripheral/serial.hpp"
+#include "Peripheral/controller.hpp"
+
+/**
+ * @brief State of one component, the order is the order in which they are restored.
+ * Values are stored in save state files, so new sections are only ever appended.
+ */
+enum class StateSection : uint32_t
+{
+    MACHINE = 0,
+    SCHEDULER,
+    CPU,
+    INTERRUPT,
+    SOC_RAM,
+    LCD_STATUS,
+    PPU,
+    APU,
+    TIMER,
+    SERIAL,
+    CONTROLLER,
+    CARTRIDGE,
+    //Last, the page table depends on the restored cartridge banks
+    MEMORY_BUS,
+    SECTION_COUNT
+};
+
+//One LCD frame, 154 lines with 456 cycles each
+#define CYCLES_PER_FRAME 70224
+
+//Cycles per second, about 59.7 frames per second
+#define CPU_FREQUENCY 4194304
+
+//Frames run-ahead has to stay within its time budget before it tries one more frame again
+#define RUN_AHEAD_RECOVERY_FRAMES 600
+
+/**
+ * @brief A complete machine, owns and wires all components. There is no shared state
+ * between instances, so any number of them can run in one process. The components
+ * keep references to each other, so an instance can neither be copied nor moved.
+ */
+class GameBoy
+{
+public:
+
+    explicit GameBoy(std::unique_ptr<Peripheral> cartridge);
+
+    GameBoy(const GameBoy&) = delete;
+    GameBoy& operator=(const GameBoy&) = delete;
+
+    /**
+     * @brief Emulates until the end of the current frame. With run-ahead the frame buffer
+     * afterwards holds a frame that lies ahead of the machine.
+     */
+    void runFrame();
+
+    /**
+     * @brief Hides input latency of the game by showing a frame from the future. Each
+     * runFrame() emulates the frame, snapshots the machine, emulates the given number of
+     * frames ahead with the input unchanged and draws the last of them, then restores the
+     * snapshot. The machine itself runs exactly as without run-ahead. While active the
+     * render policy is managed by run-ahead.
+     *
+     * When a frame takes longer than the real frame time, fewer frames are run ahead
+     * until the host keeps up again.
+     *
+     * @param frames Frames to run ahead, 0 disables run-ahead
+     */
+    void setRunAhead(unsigned frames);
+
+    /**
+     * @brief Frames currently run ahead, lower than requested while the host can not keep up
+     */
+    inline unsigned runAheadFrames() const { return m_runAheadActive; }
+
+    /**
+     * @brief Copies all mutable machine state into the buffer, which only
+     * grows on the first snapshot and can be reused afterwards
+     * 
+     * @param state Buffer receiving the state
+     */
+    void snapshot(std::vector<uint8_t>& state);
+
+    /**
+     * @brief Restores a snapshot of an instance running the same ROM, never allocates
+     * 
+     * @param state State written by snapshot()
+     * @return true if the state had the expected layout, the machine is left untouched otherwise
+     */
+    bool restore(const std::vector<uint8_t>& state);
+
+    /**
+     * @brief Saves or loads the state of a single component
+     * 
+     * @param section Component to serialize
+     * @param archive Archive to copy the state into or out of
+     */
+    void serializeSection(StateSection section, StateArchive& archive);
+
+    inline uint64_t cycles() const { return m_scheduler.now(); }
+
+    inline uint64_t frameCount() const { return m_frameCount; }
+
+    Controller& controller() { return m_controller; }
+
+    /**
+     * @brief Queues a key change for the cycle in the event, can be called from one thread
+     * other than the one running the machine. An event for a cycle that already passed
+     * takes effect at the start of the next runFrame().
+     *
+     * @return false if too many events are pending and the event was dropped
+     */
+    bool queueInput(const InputEvent& event) { return m_inputQueue.push(event); }
+
+    /**
+     * @brief Called by runFrame() once the input due at the start of the frame is applied
+     */
+    void setFrameStartHandler(std::function<void()> handler) { m_frameStartHandler = handler; }
+
+    /**
+     * @brief Called on the thread running the machine whenever a drawn frame is complete,
+     * at the start of VBlank and not at the end of runFrame(). With run-ahead only frames
+     * ahead of the machine are reported.
+     */
+    void setFrameCompleteHandler(std::function<void()> handler) { m_frameCompleteHandler = handler; }
+
+    PictureProcessingUnit& ppu() { return m_ppu; }
+
+    void setRenderPolicy(RenderPolicy policy, unsigned interval = 1);
+
+    void requestFrame() { m_ppu.requestFrame(); }
+
+    MemoryBus& memoryBus() { return m_memoryBus; }
+
+    /**
+     * @brief Selects how instructions are fetched, takes effect with the next instruction
+     */
+    void setCpuBackend(CpuBackend backend) { m_cpu.setBackend(backend); }
+
+    CpuBackend cpuBackend() const { return m_cpu.backend(); }
+
+private:
+
+    void serialize(StateArchive& archive);
+
+    void emulateFrame();
+
+    void runAheadFrame();
+
+    /**
+     * @brief Adapts the frames run ahead to the time the last runFrame() took
+     */
+    void adjustRunAhead(double seconds);
+
+    /**
+     * @brief Applies all queued events that are due
+     *
+     * @return Cycle of the next pending event
+     */
+    uint64_t applyInput();
+
+    std::unique_ptr<Peripheral> m_cartridge;
+
+    Scheduler m_scheduler;
+    InterruptController m_interruptController;
+    SocRam m_socRam;
+    LcdcStatus m_lcdStatus;
+    MemoryBus m_memoryBus;
+    PictureProcessingUnit m_ppu;
+    Cpu m_cpu;
+    SoundController m_apu;
+    Timer m_timer;
+    Serial m_serial;
+    Controller m_controller;
+
+    //Pending input, not part of the machine state
+    InputQueue m_inputQueue;
+
+    std::function<void()> m_frameStartHandler;
+    std::function<void()> m_frameCompleteHandler;
+
+    //Set while frames ahead of the machine run, they neither take input nor call the frame start handler
+    bool m_speculative = false;
+
+    unsigned m_runAheadFrames = 0;
+    unsigned m_runAheadActive = 0;
+    //Moving average of the seconds per runFrame()
+    double m_runAheadCost = 0;
+    unsigned m_runAheadRecovery = 0;
+    std::vector<uint8_t> m_runAheadState;
+
+    //Policy requested by the user, applied whenever run-ahead is inactive
+    RenderPolicy m_renderPolicy = RenderPolicy::ALL;
+    unsigned m_renderInterval = 1;
+
+    uint64_t m_frameEnd = 0;
+    uint64_t m_frameCount = 0;
+
+    //Bytes snapshot() writes, the layout does not depend on the content
+    size_t m_stateSize = 0;
+};
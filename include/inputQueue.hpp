@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "Peripheral/controller.hpp"
+
+#define INPUT_QUEUE_SIZE 256
+
+enum class InputKind : uint8_t
+{
+    BUTTON = 0,
+    DPAD
+};
+
+/**
+ * @brief A key change that takes effect at an exact emulated cycle
+ */
+struct InputEvent
+{
+    uint64_t cycle;
+    InputKind kind;
+    //Button or Dpad value, depending on the kind
+    uint8_t key;
+    bool pressed;
+};
+
+/**
+ * @brief Lock-free queue of input events from a single frontend thread to the thread that
+ * runs the machine. Events are pushed in the order of their cycles.
+ */
+class InputQueue
+{
+
+public:
+
+    /**
+     * @brief Only called by the producer
+     *
+     * @return false if the queue is full and the event was dropped
+     */
+    bool push(const InputEvent& event)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) return false;
+
+        m_events[head % INPUT_QUEUE_SIZE] = event;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Oldest event or nullptr if the queue is empty, only called by the consumer
+     */
+    const InputEvent* front() const
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) return nullptr;
+        return &m_events[tail % INPUT_QUEUE_SIZE];
+    }
+
+    /**
+     * @brief Removes the event returned by front(), only called by the consumer
+     */
+    void pop()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+
+    static_assert((INPUT_QUEUE_SIZE & (INPUT_QUEUE_SIZE - 1)) == 0, "The indices wrap around");
+
+    std::array<InputEvent, INPUT_QUEUE_SIZE> m_events = {};
+
+    //Free running, written by the producer and the consumer respectively
+    alignas(64) std::atomic<uint32_t> m_head{0};
+    alignas(64) std::atomic<uint32_t> m_tail{0};
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <span>
+#include <cstdint>
 
 namespace Instructions
 {
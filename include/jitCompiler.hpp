@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#include "instruction.hpp"
+
+//Executable memory for the translated blocks, everything is translated again once it is full
+#define JIT_CACHE_SIZE (4 * 1024 * 1024)
+//A block is only translated if this much space is left, no block gets near it
+#define JIT_BLOCK_RESERVE (64 * 1024)
+//Fewer translated instructions are left to the decoded blocks
+#define JIT_MIN_INSTRUCTIONS 4
+
+/**
+ * @brief Where the translated code finds the guest state and how it reaches the bus.
+ * The memory handlers get the cycles the block ran before the accessing instruction,
+ * so the time can be brought up to it first.
+ */
+struct JitTarget
+{
+    void* context = nullptr;
+    uint8_t (*read)(void* context, uint16_t address, uint32_t cycles) = nullptr;
+    void (*write)(void* context, uint16_t address, uint8_t value, uint32_t cycles) = nullptr;
+    //A, B, C, D, E, F, H and L in this order
+    uint8_t* registers = nullptr;
+    uint16_t* stackPointer = nullptr;
+    uint16_t* programCounter = nullptr;
+    //Set by the memory handlers, the block then ends after the current instruction
+    bool* exit = nullptr;
+};
+
+/**
+ * @brief Machine code for the leading instructions of a decoded block
+ */
+struct JitBlock
+{
+    //Whether translating was tried, code stays nullptr if too few instructions are supported
+    bool translated = false;
+    const uint8_t* code = nullptr;
+    //Guest address the code was translated for, jumps and calls are resolved against it
+    uint16_t address = 0;
+    //Cycles of the translated instructions before the last one
+    uint32_t cycles = 0;
+};
+
+/**
+ * @brief How a block ended, the program counter is already stored
+ */
+struct JitExit
+{
+    //Cycles of the last instruction that ran, the scheduler is not advanced by them yet
+    uint8_t cycles;
+    //Instructions of the block that ran
+    uint8_t instructions;
+    //Cycles of the instructions before the last one
+    uint16_t offset;
+    //Address after the last instruction that ran, where the block would continue
+    uint16_t address;
+};
+
+/**
+ * @brief Translates SM83 instructions into x86-64 code. Inside a block A, F, BC, DE, HL and SP
+ * live in host registers and are only written back when the block exits. Memory goes
+ * through the bus handlers of the target. Translation stops at the first instruction
+ * that is not supported, the rest of the block is left to the caller.
+ */
+class JitCompiler
+{
+
+public:
+
+    explicit JitCompiler(const JitTarget& target);
+
+    ~JitCompiler();
+
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    /**
+     * @brief False if no executable memory could be mapped, nothing is translated then
+     */
+    inline bool available() const { return m_cache != nullptr; }
+
+    /**
+     * @brief Translates the leading instructions of a block
+     *
+     * @param block Receives the code, left untouched if the cache is full
+     * @param address Guest address of the first instruction
+     * @return false if the cache is full, clear() it and try again
+     */
+    bool compile(JitBlock& block, uint16_t address, const Instructions::Instruction* instructions, size_t count);
+
+    /**
+     * @brief Drops all translated code, blocks translated before must not be run anymore
+     */
+    void clear();
+
+    inline JitExit run(const JitBlock& block)
+    {
+        uint64_t exit = m_enter(block.code);
+        return { (uint8_t)exit, (uint8_t)(exit >> 8), (uint16_t)(exit >> 16), (uint16_t)(exit >> 32) };
+    }
+
+private:
+
+    //Loads the guest registers, jumps to the block and returns its exit
+    using EnterFunction = uint64_t (*)(const uint8_t* code);
+
+    void emitTrampoline();
+
+    bool compileInstruction(const Instructions::Instruction& instruction, uint16_t address, uint32_t offset, uint8_t executed);
+
+    //Exit of the block after executed instructions, the last of them at offset
+    void emitExit(uint16_t programCounter, uint8_t executed, uint32_t offset, uint8_t cycles, uint16_t next, bool dynamicProgramCounter = false);
+
+    //Exit after the current instruction if a memory handler asked for it
+    void emitExitCheck(uint16_t next, uint8_t executed, uint32_t offset, uint8_t cycles);
+
+    void emitLoadRegister(uint8_t guest, uint8_t host);
+
+    void emitStoreRegister(uint8_t guest, uint8_t host);
+
+    //Address in esi, the byte is returned in eax
+    void emitRead(uint32_t offset);
+
+    //Address in esi, the byte in edx
+    void emitWrite(uint32_t offset);
+
+    void emitPushImmediate(uint16_t value, uint32_t offset);
+
+    /**
+     * @brief Sets F from the host flags of an 8-bit operation
+     *
+     * @param mask Flags taken from the operation out of Z, H and C
+     * @param set Flags that are always set
+     * @param keep Bits of F that stay as they are
+     */
+    void emitArithmeticFlags(uint8_t mask, uint8_t set, uint8_t keep);
+
+    //Sets C from the host carry and Z from the value, N and H are cleared
+    void emitRotateFlags(uint8_t valueHost, bool zero, bool carry);
+
+    void emitCallHandler(const void* handler);
+
+    //Encoding helpers, registers are numbered like in the ModRM byte, 8 to 15 are r8 to r15
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    void emitRex(bool wide, uint8_t reg, uint8_t rm, bool byteRegisters = false);
+    void emitRegister(uint8_t opCode, uint8_t reg, uint8_t rm, bool byteRegisters = false);
+    void emitExtended(uint8_t opCode, uint8_t extension, uint8_t rm, bool byteRegisters = false);
+    void emitImmediate(uint8_t extension, uint8_t rm, uint32_t value);
+    void emitShift(uint8_t extension, uint8_t rm, uint8_t count, bool byteRegister = false);
+    void emitMove(uint8_t destination, uint8_t source);
+    void emitMoveImmediate(uint8_t destination, uint32_t value);
+    void emitMoveImmediate64(uint8_t destination, uint64_t value);
+    void emitZeroExtend8(uint8_t destination, uint8_t source);
+    void emitZeroExtend16(uint8_t destination, uint8_t source);
+    size_t emitJump(uint8_t condition);
+    void patchJump(size_t at);
+
+    JitTarget m_target;
+    uint8_t* m_cache = nullptr;
+    size_t m_used = 0;
+    EnterFunction m_enter = nullptr;
+    const uint8_t* m_exit = nullptr;
+    size_t m_trampolineSize = 0;
+};
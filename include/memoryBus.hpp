@@ -1,9 +1,18 @@
 #pragma once
 
 #include <map>
+#include <array>
+#include <functional>
 #include "./Peripheral/peripheral.hpp"
 #include "./Peripheral/bootRom.hpp"
 
+#define PAGE_SIZE 0x100
+#define PAGE_COUNT 0x100
+
+//OAM, the unused range and the IO registers are not page aligned, so this area is mapped per byte
+#define HIGH_AREA_ADDRESS 0xFE00
+#define HIGH_AREA_SIZE 0x200
+
 
 class MemoryBus : public Peripheral
 {
@@ -16,6 +25,7 @@ public:
         m_memoryMap[0x0] = this;
         m_unmapBootRom.setOnWriteHandler([&](const uint16_t address, uint8_t& value){
             m_memoryMap[0x0] = m_cartridge;
+            rebuildPageTable();
         });
         registerPeripheral(this);
     }
@@ -25,7 +35,7 @@ public:
         for (uint16_t address : peripheral->peripheralAddresses())
         {
             if (address != 0x0)
-            {   
+            {
                 m_memoryMap[address] = peripheral;
             }
             else
@@ -34,37 +44,211 @@ public:
                 m_cartridge = peripheral;
             }
         }
+        peripheral->setOnRemapHandler([&](uint16_t address, uint32_t size){
+            remap(address, size);
+        });
+        rebuildPageTable();
     }
 
     /**
      * @brief Reads from a Peripheral on the memory map
-     * 
+     *
      * @param address Address in the memory map
      * @return uint8_t memoryValue
      */
     uint8_t readMemoryBus(uint16_t address)
     {
-        auto addressPeriperalIt = m_memoryMap.upper_bound(address);
-        addressPeriperalIt--;
-        return addressPeriperalIt->second->readFromPeripheral(address);
+        const MemoryPage& page = pageForAddress(address);
+        if (page.readPointer) return page.readPointer[address & page.offsetMask];
+        if (page.memory) return page.memory->readMemory(address);
+        return page.peripheral->readFromPeripheral(address);
     }
 
     /**
      * @brief Write to a Peripheral on the MemoryMap
-     * 
+     *
      * @param address Address in the memory map
      * @param value uint8_t value to write
      */
     void writeMemoryBus(uint16_t address, uint8_t value)
+    {
+        const MemoryPage& page = pageForAddress(address);
+        if (page.writePointer)
+        {
+            page.writePointer[address & page.offsetMask] = value;
+            return;
+        }
+        if (page.watched)
+        {
+            page.memory->writeMemory(address, value);
+            m_onCodeWriteHandler(address);
+            return;
+        }
+        if (page.memory) return page.memory->writeMemory(address, value);
+        return page.peripheral->writeToPeripheral(address, value);
+    }
+
+    /**
+     * @brief Host pointer to the byte at address if code read from there may be kept
+     * decoded, nullptr for memory with side effects and the per byte high area. Storage
+     * without a write pointer is read only, writes to storage with one can be watched.
+     */
+    inline const uint8_t* codePointer(uint16_t address)
+    {
+        if (address >= HIGH_AREA_ADDRESS) return nullptr;
+        const MemoryPage& page = m_pages[address >> 8];
+        if (!page.readPointer) return nullptr;
+        return page.readPointer + (address & page.offsetMask);
+    }
+
+    /**
+     * @brief Writes to the page of address go through the code write handler until
+     * unwatchCodePage()
+     *
+     * @return false for read only pages, they are never watched
+     */
+    bool watchCodePage(uint16_t address)
+    {
+        uint8_t index = address >> 8;
+        if (address >= HIGH_AREA_ADDRESS) return false;
+        if (m_watchedPages[index]) return true;
+        if (!m_pages[index].writePointer) return false;
+
+        m_watchedPages[index] = true;
+        m_pages[index] = resolvePage(index << 8, PAGE_SIZE - 1);
+        return true;
+    }
+
+    void unwatchCodePage(uint16_t address)
+    {
+        uint8_t index = address >> 8;
+        if (address >= HIGH_AREA_ADDRESS || !m_watchedPages[index]) return;
+        m_watchedPages[index] = false;
+        m_pages[index] = resolvePage(index << 8, PAGE_SIZE - 1);
+    }
+
+    void setOnCodeWriteHandler(std::function<void(uint16_t)> handler)
+    {
+        m_onCodeWriteHandler = handler;
+    }
+
+    /**
+     * @brief Called after the storage behind any address changed, e.g. on a bank switch,
+     * so code pointers taken before are no longer what the CPU would read
+     */
+    void setOnMappingChangeHandler(std::function<void()> handler)
+    {
+        m_onMappingChangeHandler = handler;
+    }
+
+    void serialize(StateArchive& archive) override
+    {
+        Peripheral::serialize(archive);
+
+        bool bootRomMapped = m_memoryMap[0x0] == this;
+        bool wasMapped = bootRomMapped;
+        archive.value(bootRomMapped);
+
+        //Bank switches are remapped by the cartridge itself, only the boot ROM mapping is left
+        if (archive.isLoading() && bootRomMapped != wasMapped)
+        {
+            m_memoryMap[0x0] = bootRomMapped ? this : m_cartridge;
+            rebuildPageTable();
+        }
+    }
+
+private:
+
+    //Pages backed by plain storage get host pointers, so the access skips the dispatch entirely
+    struct MemoryPage
+    {
+        uint8_t* readPointer = nullptr;
+        uint8_t* writePointer = nullptr;
+        uint16_t offsetMask = 0;
+        //Writable storage holding decoded code, writes take the slow path to report it
+        bool watched = false;
+        Peripheral* peripheral = nullptr;
+        Memory* memory = nullptr;
+    };
+
+    inline const MemoryPage& pageForAddress(uint16_t address)
+    {
+        if (address >= HIGH_AREA_ADDRESS) return m_highArea[address - HIGH_AREA_ADDRESS];
+        return m_pages[address >> 8];
+    }
+
+    MemoryPage resolvePage(uint16_t address, uint16_t offsetMask)
     {
         auto addressPeriperalIt = m_memoryMap.upper_bound(address);
         addressPeriperalIt--;
-        return addressPeriperalIt->second->writeToPeripheral(address, value);
+
+        MemoryPage page;
+        page.offsetMask = offsetMask;
+        page.peripheral = addressPeriperalIt->second;
+        page.memory = page.peripheral->memoryForAddress(address);
+        if (page.memory)
+        {
+            page.readPointer = page.memory->readPointer(address);
+            page.writePointer = page.memory->writePointer(address);
+        }
+        if (offsetMask == PAGE_SIZE - 1 && m_watchedPages[address >> 8] && page.writePointer)
+        {
+            page.writePointer = nullptr;
+            page.watched = true;
+        }
+        return page;
     }
 
-private:
-    Peripheral* m_cartridge;
+    /**
+     * @brief Resolves the pages of an address range again, e.g. after a bank switch
+     * 
+     * @param address Start address of the range
+     * @param size Size of the range
+     */
+    void remap(uint16_t address, uint32_t size)
+    {
+        uint32_t pageAddress = address;
+        while (pageAddress < address + size)
+        {
+            if (pageAddress >= HIGH_AREA_ADDRESS)
+            {
+                m_highArea[pageAddress - HIGH_AREA_ADDRESS] = resolvePage(pageAddress, 0);
+                pageAddress++;
+            }
+            else
+            {
+                assert((pageAddress & (PAGE_SIZE - 1)) == 0);
+                m_pages[pageAddress >> 8] = resolvePage(pageAddress, PAGE_SIZE - 1);
+                pageAddress += PAGE_SIZE;
+            }
+        }
+
+        if (m_onMappingChangeHandler) m_onMappingChangeHandler();
+    }
+
+    /**
+     * @brief Flattens the registered memory map into the page tables, has to be
+     * called whenever the mapping changes
+     */
+    void rebuildPageTable()
+    {
+        for (uint32_t address = 0; address < HIGH_AREA_ADDRESS; address += PAGE_SIZE)
+        {
+            m_pages[address >> 8] = resolvePage(address, PAGE_SIZE - 1);
+            assert(resolvePage(address + PAGE_SIZE - 1, 0).memory == m_pages[address >> 8].memory);
+        }
+
+        remap(HIGH_AREA_ADDRESS, HIGH_AREA_SIZE);
+    }
+
+    Peripheral* m_cartridge = nullptr;
     std::map<uint16_t, Peripheral*> m_memoryMap;
+    std::array<MemoryPage, PAGE_COUNT> m_pages;
+    std::array<MemoryPage, HIGH_AREA_SIZE> m_highArea;
+    //Kept by address, so a page stays watched across bank switches
+    std::array<bool, PAGE_COUNT> m_watchedPages = {};
+    std::function<void(uint16_t)> m_onCodeWriteHandler;
+    std::function<void()> m_onMappingChangeHandler;
     Register<0xFF50> m_unmapBootRom;
     BootRom bootRom;
-};
\ No newline at end of file
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gameBoy.hpp"
+
+#define MOVIE_MAGIC "GBMOVIE"
+#define MOVIE_FORMAT_VERSION 1
+
+//Frames between two checksums of the machine state, 0 records none
+#define MOVIE_CHECKSUM_INTERVAL 60
+
+enum class MovieStart : uint32_t
+{
+    //Recorded on a machine that had not run yet
+    POWER_ON = 0,
+    //Starts from the snapshot stored in the movie
+    SNAPSHOT
+};
+
+/**
+ * @brief Layout of a movie file, all values little endian:
+ *
+ *   MovieHeader
+ *   snapshot, snapshotSize bytes
+ *   joypad state of each frame, frameCount bytes
+ *   checksums, checksumCount uint64_t values
+ *
+ * The snapshot is written by GameBoy::snapshot(), so it only loads in the build that
+ * recorded it. A checksum is taken at the start of every checksumInterval-th frame.
+ */
+struct MovieHeader
+{
+    char magic[8];
+    uint32_t formatVersion;
+    MovieStart start;
+    //Identifies the ROM the movie belongs to
+    char title[16];
+    uint16_t globalChecksum;
+    uint8_t reserved[2];
+    uint32_t checksumInterval;
+    uint64_t snapshotSize;
+    uint64_t frameCount;
+    uint64_t checksumCount;
+};
+
+/**
+ * @brief Records the joypad state of every frame of a machine and feeds it back later.
+ * Input is sampled and replayed at the start of each frame, once the queued input
+ * for that cycle is applied. Playback compares the checksums and keeps the first frame
+ * at which the machine diverged from the recording.
+ */
+class Movie
+{
+
+public:
+
+    static constexpr uint64_t NO_DIVERGENCE = UINT64_MAX;
+
+    Movie() = default;
+
+    Movie(const Movie&) = delete;
+    Movie& operator=(const Movie&) = delete;
+
+    ~Movie() { stop(); }
+
+    /**
+     * @brief Starts recording from the current state of the machine
+     *
+     * @param checksumInterval Frames between two checksums, 0 records none
+     */
+    void record(GameBoy& gameBoy, uint32_t checksumInterval = MOVIE_CHECKSUM_INTERVAL);
+
+    /**
+     * @brief Brings the machine to the start of the movie and replays it from the next frame
+     *
+     * @return false if the movie belongs to another ROM, starts at power on but the machine
+     * already ran, or its snapshot does not load
+     */
+    bool play(GameBoy& gameBoy);
+
+    /**
+     * @brief Detaches from the machine, a recording keeps its frames
+     */
+    void stop();
+
+    bool write(const char* fileName) const;
+
+    bool read(const char* fileName);
+
+    inline uint64_t frameCount() const { return m_inputs.size(); }
+
+    /**
+     * @brief True once every recorded frame was replayed
+     */
+    inline bool finished() const { return m_frame >= m_inputs.size(); }
+
+    /**
+     * @brief First frame whose checksum differed from the recording or NO_DIVERGENCE
+     */
+    inline uint64_t divergentFrame() const { return m_divergentFrame; }
+
+private:
+
+    static void romIdentity(GameBoy& gameBoy, MovieHeader& header);
+
+    uint64_t checksum();
+
+    void recordFrame();
+
+    void playFrame();
+
+    GameBoy* m_gameBoy = nullptr;
+
+    MovieHeader m_header = {};
+    std::vector<uint8_t> m_snapshot;
+    std::vector<uint8_t> m_inputs;
+    std::vector<uint64_t> m_checksums;
+
+    uint64_t m_frame = 0;
+    uint64_t m_divergentFrame = NO_DIVERGENCE;
+
+    //Reused for every checksum
+    std::vector<uint8_t> m_state;
+};
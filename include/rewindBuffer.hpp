@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "gameBoy.hpp"
+
+//Bytes of compressed history kept per instance
+#define REWIND_CAPACITY (4 * 1024 * 1024)
+
+/**
+ * @brief History of machine states to step backwards through. Only the newest state is
+ * kept in full, every older one is stored as the XOR of it with its successor, run length
+ * encoded as pairs of unchanged and changed bytes. Between two frames most of the state
+ * stays the same, so an entry is a few hundred bytes. When the storage is full the oldest
+ * entries are dropped.
+ */
+class RewindBuffer
+{
+
+public:
+
+    /**
+     * @param capacity Bytes of storage for the encoded entries
+     * @param interval Frames between two captures
+     */
+    explicit RewindBuffer(size_t capacity = REWIND_CAPACITY, unsigned interval = 1);
+
+    /**
+     * @brief Called after every frame, captures the machine every interval frames
+     */
+    void update(GameBoy& gameBoy)
+    {
+        if (gameBoy.frameCount() % m_interval == 0) capture(gameBoy);
+    }
+
+    void capture(GameBoy& gameBoy);
+
+    /**
+     * @brief Restores the capture before the newest one, which then becomes the newest
+     *
+     * @return false if there is no older capture
+     */
+    bool rewind(GameBoy& gameBoy);
+
+    void clear();
+
+    /**
+     * @brief Captures that rewind() can go back to
+     */
+    inline size_t entries() const { return m_entries.size(); }
+
+    /**
+     * @brief Storage used by the encoded entries
+     */
+    size_t usedBytes() const;
+
+private:
+
+    struct Entry
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    static void encode(const uint8_t* state, const uint8_t* previous, size_t size, std::vector<uint8_t>& delta);
+
+    static bool decode(const uint8_t* delta, size_t deltaSize, uint8_t* state, size_t size);
+
+    void append(const std::vector<uint8_t>& delta);
+
+    std::vector<uint8_t> m_storage;
+    //Oldest first, the entries follow each other through the storage and wrap around
+    std::deque<Entry> m_entries;
+    size_t m_writeOffset = 0;
+
+    unsigned m_interval;
+
+    //Newest capture in full, the next capture and its delta, reused for every capture
+    std::vector<uint8_t> m_current;
+    std::vector<uint8_t> m_next;
+    std::vector<uint8_t> m_delta;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gameBoy.hpp"
+
+#define SAVE_STATE_MAGIC "GBSTATE"
+#define SAVE_STATE_FORMAT_VERSION 1
+
+//Sections start on page boundaries, so a mapped file can be handed to the loader as is
+#define SAVE_STATE_ALIGNMENT 4096
+
+/**
+ * @brief Layout of a save state file, all values little endian:
+ *
+ *   SaveStateHeader
+ *   SaveStateSection[sectionCount]
+ *   padding to SAVE_STATE_ALIGNMENT
+ *   section data, each section padded to SAVE_STATE_ALIGNMENT
+ *
+ * Sections are looked up by id, unknown ones are skipped and missing ones keep the
+ * state of the machine, so states written by older builds still load.
+ */
+struct SaveStateHeader
+{
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t sectionCount;
+    //Identifies the ROM the state belongs to
+    char title[16];
+    uint16_t globalChecksum;
+    uint8_t reserved[6];
+};
+
+struct SaveStateSection
+{
+    uint32_t id;
+    uint32_t version;
+    uint64_t offset;
+    uint64_t size;
+};
+
+class SaveState
+{
+
+public:
+
+    /**
+     * @brief Writes the complete machine state to a file
+     *
+     * @return true if the file was written
+     */
+    static bool write(GameBoy& gameBoy, const char* fileName);
+
+    /**
+     * @brief Loads a state written by write(), the file is mapped instead of read where possible
+     *
+     * @return true if the state was loaded, false if the file is invalid, belongs to
+     * another ROM or was written by a newer build
+     */
+    static bool read(GameBoy& gameBoy, const char* fileName);
+
+    /**
+     * @brief Current layout version of a section, incremented whenever the
+     * serialize() of the component changes
+     */
+    static uint32_t sectionVersion(StateSection section);
+
+private:
+
+    static void romIdentity(GameBoy& gameBoy, SaveStateHeader& header);
+
+    static bool load(GameBoy& gameBoy, const uint8_t* data, size_t size);
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+#include "stateArchive.hpp"
+
+enum class SchedulerEvent : uint8_t
+{
+    PPU_MODE = 0,
+    TIMER_OVERFLOW,
+    //Events from here on only draw or end skipped idle loops, they are not part of the machine state
+    PPU_DRAW,
+    PPU_READ,
+    EVENT_COUNT
+};
+
+using EventHandler = std::function<void(uint64_t timestamp)>;
+
+/**
+ * @brief Keeps the emulated time and the deadlines at which the peripherals change state.
+ * The CPU runs freely until the next deadline is reached, instead of every peripheral
+ * being stepped after each instruction. There are only a handful of event kinds, so each
+ * one owns a slot and the earliest deadline is cached.
+ */
+class Scheduler
+{
+public:
+
+    static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    static constexpr uint8_t STATE_EVENT_COUNT = (uint8_t)SchedulerEvent::PPU_DRAW;
+
+    Scheduler()
+    {
+        m_deadlines.fill(NEVER);
+    }
+
+    void setEventHandler(SchedulerEvent event, EventHandler handler)
+    {
+        m_handlers[(uint8_t)event] = handler;
+    }
+
+    /**
+     * @brief Schedules the event at an absolute cycle, replaces an already scheduled one
+     *
+     * @param event Event to schedule
+     * @param timestamp Cycle at which the event handler is called
+     */
+    void schedule(SchedulerEvent event, uint64_t timestamp)
+    {
+        m_deadlines[(uint8_t)event] = timestamp;
+        updateNextDeadline();
+    }
+
+    void cancel(SchedulerEvent event)
+    {
+        m_deadlines[(uint8_t)event] = NEVER;
+        updateNextDeadline();
+    }
+
+    inline uint64_t now() const { return m_now; }
+
+    inline uint64_t deadline(SchedulerEvent event) const { return m_deadlines[(uint8_t)event]; }
+
+    inline uint64_t nextDeadline() const { return m_nextDeadline; }
+
+    /**
+     * @brief Notes that a value the CPU can read changed, or was derived from the time
+     * itself. Dispatched events count as such a change as well.
+     */
+    inline void markChange() { m_lastChange = m_now; }
+
+    /**
+     * @brief Cycle of the last change, not part of the state. A loop that only reads has
+     * to see the same values as long as no change happens.
+     */
+    inline uint64_t lastChange() const { return m_lastChange; }
+
+    /**
+     * @brief Advances the emulated time and calls the handlers of all events that are due
+     *
+     * @param cycles Cycles that passed since the last call
+     */
+    inline void advance(uint64_t cycles)
+    {
+        m_now += cycles;
+        if (m_now >= m_nextDeadline) dispatchEvents();
+    }
+
+    /**
+     * @brief Saves or loads the emulated time and the deadlines of the events that change the
+     * machine state, the handlers stay as they are. The other events are cancelled on loading,
+     * their owners schedule them again.
+     */
+    void serialize(StateArchive& archive)
+    {
+        archive.value(m_now);
+        archive.bytes(m_deadlines.data(), STATE_EVENT_COUNT * sizeof(uint64_t));
+        if (archive.isLoading())
+        {
+            std::fill(m_deadlines.begin() + STATE_EVENT_COUNT, m_deadlines.end(), NEVER);
+            updateNextDeadline();
+            m_lastChange = m_now;
+        }
+    }
+
+private:
+
+    void dispatchEvents()
+    {
+        m_lastChange = m_now;
+        while (m_nextDeadline <= m_now)
+        {
+            uint8_t event = m_nextEvent;
+            uint64_t timestamp = m_deadlines[event];
+            m_deadlines[event] = NEVER;
+            updateNextDeadline();
+            m_handlers[event](timestamp);
+        }
+    }
+
+    void updateNextDeadline()
+    {
+        m_nextDeadline = NEVER;
+        for (uint8_t event = 0; event < m_deadlines.size(); event++)
+        {
+            if (m_deadlines[event] < m_nextDeadline)
+            {
+                m_nextDeadline = m_deadlines[event];
+                m_nextEvent = event;
+            }
+        }
+    }
+
+    uint64_t m_now = 0;
+    uint64_t m_nextDeadline = NEVER;
+    uint8_t m_nextEvent = 0;
+    uint64_t m_lastChange = 0;
+
+    std::array<uint64_t, (uint8_t)SchedulerEvent::EVENT_COUNT> m_deadlines;
+    std::array<EventHandler, (uint8_t)SchedulerEvent::EVENT_COUNT> m_handlers;
+};
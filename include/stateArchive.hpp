@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief Copies the machine state into or out of one contiguous buffer. Every component
+ * describes its state once in serialize(), the same walk is used for saving and loading,
+ * so both sides always agree on the layout.
+ */
+class StateArchive
+{
+public:
+
+    //Version of data written by this build, such as snapshots, whatever the section versions are
+    static constexpr uint32_t CURRENT_VERSION = UINT32_MAX;
+
+    /**
+     * @brief Archive that saves into the buffer, the buffer only grows on the first save
+     */
+    explicit StateArchive(std::vector<uint8_t>& buffer) :
+        m_saveBuffer(&buffer), m_loadData(nullptr), m_size(0)
+    { }
+
+    /**
+     * @brief Archive that only counts the bytes a save would take
+     */
+    StateArchive() :
+        m_saveBuffer(nullptr), m_loadData(nullptr), m_size(0)
+    { }
+
+    /**
+     * @brief Archive that loads from the data, never allocates
+     */
+    StateArchive(const uint8_t* data, size_t size, uint32_t version = CURRENT_VERSION) :
+        m_saveBuffer(nullptr), m_loadData(data), m_size(size), m_version(version)
+    { }
+
+    inline bool isLoading() const { return m_loadData != nullptr; }
+
+    /**
+     * @brief Layout version of the data being loaded, lets serialize() read states
+     * written before its layout changed. 0 is the first layout, CURRENT_VERSION the
+     * one of this build.
+     */
+    inline uint32_t version() const { return m_version; }
+
+    inline size_t position() const { return m_position; }
+
+    /**
+     * @brief True if a load ran past the end of the data, nothing is copied from then on
+     */
+    inline bool overrun() const { return m_overrun; }
+
+    template<typename T>
+    inline void value(T& value)
+    {
+        bytes(&value, sizeof(T));
+    }
+
+    void bytes(void* data, size_t size)
+    {
+        if (isLoading())
+        {
+            if (m_overrun || m_position + size > m_size)
+            {
+                m_overrun = true;
+                return;
+            }
+            memcpy(data, m_loadData + m_position, size);
+        }
+        else if (m_saveBuffer)
+        {
+            if (m_position + size > m_saveBuffer->size()) m_saveBuffer->resize(m_position + size);
+            memcpy(m_saveBuffer->data() + m_position, data, size);
+        }
+        m_position += size;
+    }
+
+    /**
+     * @brief Drops whatever is left of a previous, larger save
+     */
+    void finish()
+    {
+        if (m_saveBuffer) m_saveBuffer->resize(m_position);
+    }
+
+private:
+
+    std::vector<uint8_t>* m_saveBuffer;
+    const uint8_t* m_loadData;
+    size_t m_size;
+    uint32_t m_version = CURRENT_VERSION;
+    size_t m_position = 0;
+    bool m_overrun = false;
+};
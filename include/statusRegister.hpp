@@ -12,6 +12,24 @@ namespace
     };
 }
 
+/**
+ * @brief 8-bit operations whose flags follow from the operands and the result alone
+ */
+enum class FlagOperation : uint8_t
+{
+    //No pending operation, the flags are in F
+    NONE = 0,
+    //ADD and ADC, the result includes the carry
+    ADD,
+    //SUB, SBC and CP, the result includes the carry
+    SUB,
+    INC,
+    DEC,
+    AND,
+    OR,
+    XOR
+};
+
 class StatusRegister
 {
     public:
@@ -19,8 +37,63 @@ class StatusRegister
     StatusRegister(uint8_t& registerF) : statusRegister(&registerF)
     {};
 
+    /**
+     * @brief Sets the flags the way the operation leaves them, INC and DEC keep the carry.
+     * With GBEMU_LAZY_FLAGS only the operation is recorded and F is computed once it is read.
+     *
+     * @param operation Operation that produced the result
+     * @param operandA Left operand, the register for INC and DEC
+     * @param operandB Right operand, 1 for INC and DEC
+     * @param result Unmasked result, bit 8 is the carry or borrow out
+     */
+    void inline setFlags(FlagOperation operation, uint8_t operandA, uint8_t operandB, uint16_t result)
+    {
+#ifdef GBEMU_LAZY_FLAGS
+        //Taken from the pending operation before it is replaced
+        m_keptCarry = (operation == FlagOperation::INC || operation == FlagOperation::DEC) && isCarryFlagSet() ? RegisterFlag::CARRY_FLAG : 0;
+        m_operation = operation;
+        m_operandA = operandA;
+        m_operandB = operandB;
+        m_result = result;
+#else
+        *statusRegister = computeFlags(operation, operandA, operandB, result, *statusRegister & RegisterFlag::CARRY_FLAG) | (*statusRegister & 0x0F);
+#endif
+    }
+
+    /**
+     * @brief Replaces Z, N, H and C, e.g. with flags from a lookup table
+     */
+    void inline assignFlags(uint8_t flags)
+    {
+        discard();
+        *statusRegister = flags | (*statusRegister & 0x0F);
+    }
+
+    /**
+     * @brief Writes the flags of a pending operation into F, needed before F is read directly
+     */
+    void inline flush()
+    {
+#ifdef GBEMU_LAZY_FLAGS
+        if (m_operation == FlagOperation::NONE) return;
+        *statusRegister = computeFlags(m_operation, m_operandA, m_operandB, m_result, m_keptCarry) | (*statusRegister & 0x0F);
+        m_operation = FlagOperation::NONE;
+#endif
+    }
+
+    /**
+     * @brief Drops a pending operation, needed before F is written directly
+     */
+    void inline discard()
+    {
+#ifdef GBEMU_LAZY_FLAGS
+        m_operation = FlagOperation::NONE;
+#endif
+    }
+
     void inline checkZeroFlag(uint8_t operand)
     {
+        flush();
         if (!operand)
             *statusRegister |= RegisterFlag::ZERO_FLAG;
         else
@@ -29,26 +102,33 @@ class StatusRegister
 
     void inline resetZeroFlag()
     {
+        flush();
         *statusRegister &= ~RegisterFlag::ZERO_FLAG;
     }
 
     bool inline isZeroFlagSet()
     {
+#ifdef GBEMU_LAZY_FLAGS
+        if (m_operation != FlagOperation::NONE) return (uint8_t)m_result == 0;
+#endif
         return *statusRegister & RegisterFlag::ZERO_FLAG;
     }
 
     void inline setNegativFlag()
     {
+        flush();
         *statusRegister |= RegisterFlag::SUB_FLAG;
     }
 
     void inline resetNegativFlag()
     {
+        flush();
         *statusRegister &= ~RegisterFlag::SUB_FLAG;
     }
 
     bool inline isNegativFlagSet()
     {
+        flush();
         return *statusRegister & RegisterFlag::SUB_FLAG;
     }
 
@@ -56,6 +136,7 @@ class StatusRegister
 
     void inline checkHalfCarryFlag16BitAdd(uint16_t operandA, uint16_t operandB)
     {
+        flush();
         if ((((operandA & 0xFFF) + (operandB & 0xFFF)) & 0x1000) == 0x1000)
             *statusRegister |= RegisterFlag::HALF_CARRY_FLAG;
         else
@@ -64,6 +145,7 @@ class StatusRegister
 
     void inline checkCarryFlag16BitAdd(uint32_t operandA, uint32_t operandB)
     {
+        flush();
         if (operandA + operandB > 0xFFFF)
             *statusRegister |= RegisterFlag::CARRY_FLAG;
         else
@@ -72,6 +154,7 @@ class StatusRegister
 
     void inline checkHalfCarryFlag8BitAdd(uint16_t operandA, uint16_t operandB)
     {
+        flush();
         if ((((operandA & 0x0F) + (operandB & 0x0F)) & 0x10) == 0x10)
             *statusRegister |= RegisterFlag::HALF_CARRY_FLAG;
         else
@@ -80,6 +163,7 @@ class StatusRegister
 
     void inline checkCarryFlag8BitAdd(uint32_t operandA, uint32_t operandB)
     {
+        flush();
         if (operandA + operandB > 0xFF)
             *statusRegister |= RegisterFlag::CARRY_FLAG;
         else
@@ -90,6 +174,7 @@ class StatusRegister
 
     void inline checkHalfCarryFlag16BitSub(uint16_t minuend, uint16_t subtrahend)
     {
+        flush();
         if ((minuend & 0xFFF) < (subtrahend & 0xFFF))
             *statusRegister |= RegisterFlag::HALF_CARRY_FLAG;
         else
@@ -98,6 +183,7 @@ class StatusRegister
 
     void inline checkCarryFlag16BitSub(uint32_t minuend, uint32_t subtrahend)
     {
+        flush();
         if (minuend < subtrahend)
             *statusRegister |= RegisterFlag::CARRY_FLAG;
         else
@@ -106,6 +192,7 @@ class StatusRegister
 
     void inline checkHalfCarryFlag8BitSub(uint8_t minuend, uint8_t subtrahend)
     {
+        flush();
         if ((minuend & 0x0F) < (subtrahend & 0x0F))
             *statusRegister |= RegisterFlag::HALF_CARRY_FLAG;
         else
@@ -114,6 +201,7 @@ class StatusRegister
 
     void inline checkCarryFlag8BitSub(uint32_t minuend, uint32_t subtrahend)
     {
+        flush();
         if (minuend < subtrahend)
             *statusRegister |= RegisterFlag::CARRY_FLAG;
         else
@@ -124,39 +212,89 @@ class StatusRegister
 
     void inline resetHalfCarryFlag()
     {
+        flush();
         *statusRegister &= ~RegisterFlag::HALF_CARRY_FLAG;
     }
 
     void inline setHalfCarryFlag()
     {
+        flush();
         *statusRegister |= RegisterFlag::HALF_CARRY_FLAG;
     }
 
     bool inline isHalfCarryFlagSet()
     {
+        flush();
         return *statusRegister & RegisterFlag::HALF_CARRY_FLAG;
     }
 
     void inline setCarryFlag()
     {
+        flush();
         *statusRegister |= RegisterFlag::CARRY_FLAG;
     }
 
     void inline resertCarryFlag()
     {
+        flush();
         *statusRegister &= ~RegisterFlag::CARRY_FLAG;
     }
 
     bool inline isCarryFlagSet()
     {
+#ifdef GBEMU_LAZY_FLAGS
+        switch(m_operation)
+        {
+            case FlagOperation::NONE: break;
+            case FlagOperation::ADD:
+            case FlagOperation::SUB: return m_result & 0x100;
+            case FlagOperation::INC:
+            case FlagOperation::DEC: return m_keptCarry;
+            case FlagOperation::AND:
+            case FlagOperation::OR:
+            case FlagOperation::XOR: return false;
+        }
+#endif
         return *statusRegister & RegisterFlag::CARRY_FLAG;
     }
 
     const uint8_t& getStatusRegister()
     {
+        flush();
         return *statusRegister;
     }
 
     private:
+
+    static uint8_t inline computeFlags(FlagOperation operation, uint8_t operandA, uint8_t operandB, uint16_t result, uint8_t keptCarry)
+    {
+        uint8_t flags = (uint8_t)result == 0 ? RegisterFlag::ZERO_FLAG : 0;
+        //Carry out of bit 3, the same for additions and subtractions
+        uint8_t halfCarry = ((operandA ^ operandB ^ result) & 0x10) << 1;
+        uint8_t carry = (result >> 4) & RegisterFlag::CARRY_FLAG;
+
+        switch(operation)
+        {
+            case FlagOperation::NONE: break;
+            case FlagOperation::ADD: flags |= halfCarry | carry; break;
+            case FlagOperation::SUB: flags |= RegisterFlag::SUB_FLAG | halfCarry | carry; break;
+            case FlagOperation::INC: flags |= halfCarry | keptCarry; break;
+            case FlagOperation::DEC: flags |= RegisterFlag::SUB_FLAG | halfCarry | keptCarry; break;
+            case FlagOperation::AND: flags |= RegisterFlag::HALF_CARRY_FLAG; break;
+            case FlagOperation::OR:
+            case FlagOperation::XOR: break;
+        }
+        return flags;
+    }
+
     uint8_t* statusRegister;
+
+#ifdef GBEMU_LAZY_FLAGS
+    //Last flag setting operation, F only holds its flags after flush()
+    FlagOperation m_operation = FlagOperation::NONE;
+    uint8_t m_operandA = 0;
+    uint8_t m_operandB = 0;
+    uint16_t m_result = 0;
+    uint8_t m_keptCarry = 0;
+#endif
 };
\ No newline at end of file
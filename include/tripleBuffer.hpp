@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Lock-free hand over of whole frames from one producer thread to one consumer thread.
+ * The producer fills the back buffer and publishes it, the consumer picks up the newest
+ * published buffer. Neither side ever waits and the consumer never sees a half written buffer.
+ */
+template <typename T>
+class TripleBuffer
+{
+
+public:
+
+    /**
+     * @brief Buffer the producer may write to, only valid on the producer thread
+     */
+    inline T& back() { return m_buffers[m_back]; }
+
+    /**
+     * @brief Swaps the back buffer with the shared one and marks it fresh. A frame the
+     * consumer did not pick up yet is overwritten.
+     */
+    void publish()
+    {
+        uint8_t previous = m_shared.exchange(m_back | FRESH, std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+    }
+
+    /**
+     * @brief Takes the newest published buffer if there is one
+     *
+     * @return True if front() changed since the last call
+     */
+    bool acquire()
+    {
+        if (!(m_shared.load(std::memory_order_relaxed) & FRESH)) return false;
+
+        uint8_t previous = m_shared.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX_MASK;
+        return true;
+    }
+
+    /**
+     * @brief Buffer last taken by acquire(), only valid on the consumer thread
+     */
+    inline const T& front() const { return m_buffers[m_front]; }
+
+private:
+
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    T m_buffers[3] = {};
+
+    //Index of the buffer in between producer and consumer and whether it holds an unread frame
+    std::atomic<uint8_t> m_shared{1};
+
+    //Each owned by one side only
+    uint8_t m_back = 0;
+    uint8_t m_front = 2;
+};
@@ -1,82 +1,81 @@
 #include <stdio.h>
+#include <string.h>
+#ifdef __APPLE__
 #include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
 #include <iostream>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <thread>
 
-#include "include/cpu.hpp"
-#include "include/Interrupt/InterruptController.hpp"
-#include "include/Peripheral/ppu.hpp"
-#include "include/Peripheral/lcdcStatus.hpp"
-#include "include/Peripheral/bootRom.hpp"
-#include "include/Peripheral/soundController.hpp"
-#include "include/memoryBus.hpp"
-#include "include/Peripheral/socRAM.hpp"
-#include "include/Peripheral/timer.hpp"
-#include "include/Peripheral/serial.hpp"
+#include "include/gameBoy.hpp"
+#include "include/tripleBuffer.hpp"
+#include "include/rewindBuffer.hpp"
 #include "include/Cartridge/cartridgeBuilder.hpp"
-#include "include/Peripheral/controller.hpp"
 
 // Display size
 #define SCREEN_HEIGHT 144
 #define SCREEN_WIDTH 160
 
+//The GL thread looks for a new frame this often, frames come about every 17 ms
+#define FRAME_POLL_MILLISECONDS 4
+
 int modifier = 2;
 
-uint8_t frameBuffer[V_RES][H_RES];
+uint8_t pixels[V_RES][H_RES][3];
 
 // Window size
 int display_width = SCREEN_WIDTH * modifier;
 int display_height = SCREEN_HEIGHT * modifier;
 
 void display();
+void pollFrame(int value);
 void reshape_window(GLsizei w, GLsizei h);
 void keyboardUp(unsigned char key, int x, int y);
 void keyboardDown(unsigned char key, int x, int y);
 void specialUp(int key, int x, int y);
 void specialDown(int key, int x, int y);
 void setupTexture();
+void emulate();
+void stopEmulation();
+void queueInput(InputKind kind, uint8_t key, bool pressed);
+
+std::unique_ptr<GameBoy> gameBoy;
+
+//Completed frames as shades, written by the emulation thread and read by the GL thread
+using Frame = std::array<uint8_t, V_RES * H_RES>;
+TripleBuffer<Frame> frames;
+
+//Input from the GL thread is stamped with the first cycle of the next emulated frame
+std::atomic<uint64_t> nextFrameCycle{0};
 
-InterruptController interruptController;
-SocRam socRam;
-LcdcStatus lcdStatus(interruptController);
-MemoryBus memoryBus;
-PictureProcessingUnit ppu(interruptController, lcdStatus);
-Cpu cpu(interruptController, memoryBus);
-SoundController apu;
-Timer timer(interruptController);
-Serial serial;
-Controller controller(interruptController);
+//Held 'r' key, the emulation thread steps back one captured frame per frame instead
+std::atomic<bool> rewinding{false};
+RewindBuffer rewindBuffer;
+
+std::atomic<bool> emulationRunning{true};
+std::thread emulationThread;
 
 
 int main(int argc, char **argv) 
 {		
 	if(argc < 2)
 	{
-		printf("Usage: myChip8.exe chip8application\n\n");
+		printf("Usage: GBEmu rom [run-ahead frames]\n\n");
 		return 1;
 	}
 	
-	auto cartridge = CartridgeBuilder::openROM(argv[1]);
-	
-	memoryBus.registerPeripheral(&socRam);
-    memoryBus.registerPeripheral(&ppu);
-    memoryBus.registerPeripheral(&apu);
-    memoryBus.registerPeripheral(&lcdStatus);
-	memoryBus.registerPeripheral(cartridge.get());
-	memoryBus.registerPeripheral(&timer);
-	memoryBus.registerPeripheral(&interruptController);
-	memoryBus.registerPeripheral(&serial);
-	memoryBus.registerPeripheral(&controller);
-
-	ppu.registerDmaHandler([](const uint16_t _address, uint8_t& value)
-	{
-		uint16_t address = value * 0x100;
-		for (int i = 0; i < OAM_SIZE; i++)
-		{
-			uint8_t ramValue = memoryBus.readMemoryBus(address + i);
-			ppu.objectAttributeMemory()[i] = ramValue;
-		}
+	gameBoy = std::make_unique<GameBoy>(CartridgeBuilder::openROM(argv[1]));
+	if (argc > 2) gameBoy->setRunAhead(atoi(argv[2]));
+
+	//Taken at VBlank, a frame copied at the end of runFrame() would mix two frames
+	gameBoy->setFrameCompleteHandler([](){
+		Frame& frame = frames.back();
+		memcpy(frame.data(), gameBoy->ppu().frameBuffer, frame.size());
+		frames.publish();
 	});
     
 	// Setup OpenGL
@@ -88,7 +87,7 @@ int main(int argc, char **argv)
 	glutCreateWindow("myChip8 by Laurence Muller");
 	
 	glutDisplayFunc(display);
-	glutIdleFunc(display);
+	glutTimerFunc(FRAME_POLL_MILLISECONDS, pollFrame, 0);
     glutReshapeFunc(reshape_window);
 
 	glutKeyboardFunc(keyboardDown);
@@ -100,6 +99,9 @@ int main(int argc, char **argv)
 
 	setupTexture();			
 
+	//exit() from the GL thread stops the emulation before the machine is destroyed
+	emulationThread = std::thread(emulate);
+	atexit(stopEmulation);
 
 	glutMainLoop(); 
 
@@ -110,7 +112,7 @@ int main(int argc, char **argv)
 void setupTexture()
 {
 	// Create a texture 
-	glTexImage2D(GL_TEXTURE_2D, 0, 3, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)ppu.screenData);
+	glTexImage2D(GL_TEXTURE_2D, 0, 3, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)pixels);
 
 	// Set up the texture
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -122,11 +124,15 @@ void setupTexture()
 	glEnable(GL_TEXTURE_2D);
 }
 
-void updateTexture(PictureProcessingUnit& ppu)
+void updateTexture(const Frame& frame)
 {	
 	// Update Texture
-	glTexSubImage2D(GL_TEXTURE_2D, 0 ,0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)ppu.screenData);
+	FrameConverter::convert(frame.data(), frame.size(), PixelFormat::RGB888, pixels);
+	glTexSubImage2D(GL_TEXTURE_2D, 0 ,0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)pixels);
+}
 
+void drawTexture()
+{
 	glBegin( GL_QUADS );
 		glTexCoord2d(0.0, 0.0);		glVertex2d(0.0,			  0.0);
 		glTexCoord2d(1.0, 0.0); 	glVertex2d(display_width, 0.0);
@@ -148,24 +154,66 @@ void drawPixel(int x, int y)
 
 void display()
 {
-    const int MAXCYCLES = 69905 ;
-    int cyclesThisUpdate = 0 ;
-
-    while (cyclesThisUpdate < MAXCYCLES)
-    {
-        uint8_t ticks = cpu.step();
-        ppu.tick(ticks);
-		timer.step(ticks);
-        cyclesThisUpdate += ticks;
-    }
-        
     glClear(GL_COLOR_BUFFER_BIT);
     
-    updateTexture(ppu);
+    drawTexture();
 
 	glutSwapBuffers();    
 }
 
+void pollFrame(int value)
+{
+    //Only a frame the emulation thread completed since the last poll is uploaded and drawn
+    if (frames.acquire())
+    {
+        updateTexture(frames.front());
+        glutPostRedisplay();
+    }
+
+    glutTimerFunc(FRAME_POLL_MILLISECONDS, pollFrame, 0);
+}
+
+void emulate()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto framePeriod = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>((double)CYCLES_PER_FRAME / CPU_FREQUENCY));
+
+    auto nextFrame = Clock::now();
+    while (emulationRunning.load(std::memory_order_relaxed))
+    {
+        if (rewinding.load(std::memory_order_relaxed))
+        {
+            //The frame buffer is not part of the state, one frame is run to draw the restored one
+            rewindBuffer.rewind(*gameBoy);
+            gameBoy->runFrame();
+        }
+        else
+        {
+            gameBoy->runFrame();
+            rewindBuffer.update(*gameBoy);
+        }
+        nextFrameCycle.store(gameBoy->cycles(), std::memory_order_relaxed);
+
+        //Paced to the real frame rate independent of the display, a late frame is not caught up
+        nextFrame += framePeriod;
+        auto now = Clock::now();
+        if (nextFrame < now) nextFrame = now;
+        std::this_thread::sleep_until(nextFrame);
+    }
+}
+
+void queueInput(InputKind kind, uint8_t key, bool pressed)
+{
+    gameBoy->queueInput({ nextFrameCycle.load(std::memory_order_relaxed), kind, key, pressed });
+}
+
+void stopEmulation()
+{
+    emulationRunning = false;
+    if (emulationThread.joinable()) emulationThread.join();
+}
+
 void reshape_window(GLsizei w, GLsizei h)
 {
 	glClearColor(0.0f, 0.0f, 0.5f, 0.0f);
@@ -187,10 +235,11 @@ void keyboardDown(unsigned char key, int x, int y)
 
 	switch(key)
 	{
-		case 'a' : controller.buttonPressed(Button::BUTTON_A); break;
-		case 's' : controller.buttonPressed(Button::BUTTON_B); break;
-		case 'z' : controller.buttonPressed(Button::BUTTON_SELECT); break;
-		case 'x' : controller.buttonPressed(Button::BUTTON_START); break;
+		case 'a' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_A, true); break;
+		case 's' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_B, true); break;
+		case 'z' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_SELECT, true); break;
+		case 'x' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_START, true); break;
+		case 'r' : rewinding = true; break;
 	}
 }
 
@@ -198,10 +247,10 @@ void specialDown(int key, int x, int y)
 {
 	switch(key)
 	{
-		case GLUT_KEY_UP: controller.dpadPressed(Dpad::DPAD_UP); break;
-		case GLUT_KEY_DOWN: controller.dpadPressed(Dpad::DPAD_DOWN); break;
-		case GLUT_KEY_LEFT: controller.dpadPressed(Dpad::DPAD_LEFT); break;
-		case GLUT_KEY_RIGHT: controller.dpadPressed(Dpad::DPAD_RIGHT); break;
+		case GLUT_KEY_UP: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_UP, true); break;
+		case GLUT_KEY_DOWN: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_DOWN, true); break;
+		case GLUT_KEY_LEFT: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_LEFT, true); break;
+		case GLUT_KEY_RIGHT: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_RIGHT, true); break;
 	}
 }
 
@@ -209,10 +258,10 @@ void specialUp(int key, int x, int y)
 {
 	switch(key)
 	{
-		case GLUT_KEY_UP: controller.dpadReleased(Dpad::DPAD_UP); break;
-		case GLUT_KEY_DOWN: controller.dpadReleased(Dpad::DPAD_DOWN); break;
-		case GLUT_KEY_LEFT: controller.dpadReleased(Dpad::DPAD_LEFT); break;
-		case GLUT_KEY_RIGHT: controller.dpadReleased(Dpad::DPAD_RIGHT); break;
+		case GLUT_KEY_UP: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_UP, false); break;
+		case GLUT_KEY_DOWN: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_DOWN, false); break;
+		case GLUT_KEY_LEFT: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_LEFT, false); break;
+		case GLUT_KEY_RIGHT: queueInput(InputKind::DPAD, (uint8_t)Dpad::DPAD_RIGHT, false); break;
 	}
 }
 
@@ -220,9 +269,10 @@ void keyboardUp(unsigned char key, int x, int y)
 {
 	switch(key)
 	{
-		case 'a' : controller.buttonReleased(Button::BUTTON_A); break;
-		case 's' : controller.buttonReleased(Button::BUTTON_B); break;
-		case 'z' : controller.buttonReleased(Button::BUTTON_SELECT); break;
-		case 'x' : controller.buttonReleased(Button::BUTTON_START); break;
+		case 'a' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_A, false); break;
+		case 's' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_B, false); break;
+		case 'z' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_SELECT, false); break;
+		case 'x' : queueInput(InputKind::BUTTON, (uint8_t)Button::BUTTON_START, false); break;
+		case 'r' : rewinding = false; break;
 	}
 }
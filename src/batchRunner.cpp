@@ -0,0 +1,117 @@
+#include "../include/batchRunner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+BatchRunner::BatchRunner(unsigned threadCount, unsigned framesPerQuantum) :
+    m_threadCount(threadCount),
+    m_framesPerQuantum(framesPerQuantum)
+{
+    if (m_threadCount == 0) m_threadCount = std::max(1u, std::thread::hardware_concurrency());
+    if (m_framesPerQuantum == 0) m_framesPerQuantum = 1;
+
+    m_queues = std::make_unique<WorkQueue[]>(m_threadCount);
+}
+
+void BatchRunner::addInstance(std::unique_ptr<GameBoy> gameBoy, uint64_t frames)
+{
+    BatchInstance instance;
+    instance.gameBoy = std::move(gameBoy);
+    instance.frames = frames;
+    m_instances.push_back(std::move(instance));
+}
+
+double BatchRunner::run()
+{
+    m_pending = 0;
+    for (size_t index = 0; index < m_instances.size(); index++)
+    {
+        if (m_instances[index].framesDone >= m_instances[index].frames) continue;
+
+        //Round robin start, the stealing takes care of any imbalance
+        m_queues[index % m_threadCount].indices.push_back(index);
+        m_pending++;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned id = 1; id < m_threadCount; id++)
+    {
+        workers.emplace_back(&BatchRunner::worker, this, id);
+    }
+    worker(0);
+
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void BatchRunner::worker(unsigned id)
+{
+    size_t index;
+
+    while (m_pending.load(std::memory_order_acquire) > 0)
+    {
+        if (!popLocal(id, index) && !steal(id, index))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        BatchInstance& instance = m_instances[index];
+        auto start = std::chrono::steady_clock::now();
+
+        for (unsigned frame = 0; frame < m_framesPerQuantum && instance.framesDone < instance.frames; frame++)
+        {
+            instance.gameBoy->runFrame();
+            instance.framesDone++;
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        instance.busySeconds += elapsed.count();
+
+        if (instance.framesDone < instance.frames)
+        {
+            std::lock_guard<std::mutex> lock(m_queues[id].mutex);
+            m_queues[id].indices.push_back(index);
+        }
+        else
+        {
+            m_pending.fetch_sub(1, std::memory_order_release);
+        }
+    }
+}
+
+bool BatchRunner::popLocal(unsigned id, size_t& index)
+{
+    WorkQueue& queue = m_queues[id];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.indices.empty()) return false;
+
+    index = queue.indices.back();
+    queue.indices.pop_back();
+    return true;
+}
+
+bool BatchRunner::steal(unsigned id, size_t& index)
+{
+    for (unsigned offset = 1; offset < m_threadCount; offset++)
+    {
+        WorkQueue& queue = m_queues[(id + offset) % m_threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.indices.empty()) continue;
+
+        index = queue.indices.front();
+        queue.indices.pop_front();
+        return true;
+    }
+    return false;
+}
@@ -1,27 +1,412 @@
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
 #include "../include/cpu.hpp"
 
+#ifdef GBEMU_ALU_TABLES
+    #include "../include/aluTables.hpp"
+#endif
 
-uint8_t Cpu::step()
+
+GBEMU_ALWAYS_INLINE bool Cpu::checkHalt()
+{
+    if (m_interruptController->shouldWakeupFronHalt()) m_isHalted = false;
+
+    //Every further cycle until an interrupt is raised is the same
+    m_idleLoopCycles = m_isHalted ? 1 : 0;
+    return m_isHalted;
+}
+
+template<CpuBackend t_backend>
+GBEMU_ALWAYS_INLINE uint8_t Cpu::executeInstruction()
 {
     // printf("A: %02X F: %02X B: %02X C: %02X D: %02X E: %02X H: %02X L: %02X SP: %04X PC: 00:%04X (%02X %02X %02X %02X)\n", 
     //         gpRegister.registerA, gpRegister.registerF, gpRegister.registerB, gpRegister.registerC, gpRegister.registerD, gpRegister.registerE, gpRegister.registerH, gpRegister.registerL,
     //         stackPointer, programmCounter,
     //         m_memoryMap->readMemoryBus(programmCounter), m_memoryMap->readMemoryBus(programmCounter + 1), m_memoryMap->readMemoryBus(programmCounter + 2), m_memoryMap->readMemoryBus(programmCounter + 3));
-    if (m_interruptController->shouldWakeupFronHalt()) m_isHalted = false;
-    if (m_isHalted) return 1;
+    bool decoded = false;
+    if (t_backend != CpuBackend::INTERPRETER && !(decoded = continueBlock()))
+    {
+        CodeBlock* block = enterBlock();
+#ifdef GBEMU_JIT
+        //The whole block runs, only the cycles of its last instruction are left to the caller
+        if (t_backend == CpuBackend::JIT && block && canRunCompiled(*block)) return runCompiled(*block);
+#endif
+        decoded = block && continueBlock();
+    }
 
-    fetch();
-    decode();
-    execute();
-    if (m_interruptController->hasPendingInterrupt())
+    if (!decoded)
     {
-        m_interruptController->disableInterrupts();
-        call(m_interruptController->pendingInterruptAddress());
-        currentInstruction.cycles+=20;
+        fetch();
+        decode();
     }
+    execute();
     return currentInstruction.cycles;
 }
 
+GBEMU_ALWAYS_INLINE uint8_t Cpu::serviceInterrupt()
+{
+    if (!m_interruptController->hasPendingInterrupt()) return 0;
+
+    m_interruptController->disableInterrupts();
+    call(m_interruptController->pendingInterruptAddress());
+    return 20;
+}
+
+GBEMU_ALWAYS_INLINE uint8_t Cpu::stepInstruction()
+{
+    if (checkHalt()) return 1;
+
+    uint8_t cycles = m_backend == CpuBackend::INTERPRETER ? executeInstruction<CpuBackend::INTERPRETER>() : executeInstruction<CpuBackend::DECODED_BLOCKS>();
+    return cycles + serviceInterrupt();
+}
+
+uint8_t Cpu::step()
+{
+    return stepInstruction();
+}
+
+template<CpuBackend t_backend>
+GBEMU_ALWAYS_INLINE uint8_t Cpu::runInstructions()
+{
+    Scheduler& scheduler = m_scheduler;
+
+    while (true)
+    {
+        uint8_t cycles = executeInstruction<t_backend>();
+        if (scheduler.now() + cycles >= m_runLimit) return cycles;
+        scheduler.advance(cycles);
+    }
+}
+
+uint64_t Cpu::runUntil(uint64_t deadline)
+{
+    Scheduler& scheduler = m_scheduler;
+    uint64_t start = scheduler.now();
+
+    while (scheduler.now() < deadline)
+    {
+        uint8_t cycles = 1;
+        if (!checkHalt())
+        {
+            //Until an interrupt can become pending, the CPU halts or enters an idle loop,
+            //every instruction is followed by nothing but the next one
+            m_runLimit = m_interruptController->hasPendingInterrupt() ? 0 : deadline;
+            switch (m_backend)
+            {
+                case CpuBackend::INTERPRETER: cycles = runInstructions<CpuBackend::INTERPRETER>(); break;
+#ifdef GBEMU_JIT
+                case CpuBackend::JIT: cycles = runInstructions<CpuBackend::JIT>(); break;
+#endif
+                default: cycles = runInstructions<CpuBackend::DECODED_BLOCKS>(); break;
+            }
+            cycles += serviceInterrupt();
+        }
+
+        scheduler.advance(cycles);
+        if (m_idleLoopCycles) skipIdleLoop(deadline);
+    }
+    return scheduler.now() - start;
+}
+
+void Cpu::skipIdleLoop(uint64_t deadline)
+{
+    Scheduler& scheduler = m_scheduler;
+
+    //The iteration the CPU saw and the one it is in have to be free of changes. A halted
+    //CPU reads nothing, it checked for a raised interrupt in the step that just ran.
+    uint64_t now = scheduler.now();
+    if (!m_isHalted && scheduler.lastChange() + 2 * (uint64_t)m_idleLoopCycles > now) return;
+
+    //Whole iterations only, ending at the latest on the cycle of the next event, which is
+    //then dispatched at the same point of the loop as without skipping
+    uint64_t limit = std::min(deadline, scheduler.nextDeadline());
+    if (limit <= now) return;
+    uint64_t iterations = (limit - now) / m_idleLoopCycles;
+    if (iterations) scheduler.advance(iterations * m_idleLoopCycles);
+}
+
+void Cpu::serialize(StateArchive& archive)
+{
+    //The current instruction is only valid within step(), so it is not part of the state
+    statusRegister.flush();
+    archive.value(gpRegister);
+    archive.value(stackPointer);
+    archive.value(programmCounter);
+    archive.value(m_isHalted);
+
+    if (archive.isLoading()) invalidateWritableCode();
+}
+
+void Cpu::setBackend(CpuBackend backend)
+{
+#ifdef GBEMU_JIT
+    if (backend == CpuBackend::JIT && !m_jit)
+    {
+        static_assert(sizeof(GeneralRegister) == 8, "The compiled code expects A, B, C, D, E, F, H and L in a row");
+        JitTarget target;
+        target.context = this;
+        target.read = &Cpu::compiledRead;
+        target.write = &Cpu::compiledWrite;
+        target.registers = &gpRegister.registerA;
+        target.stackPointer = &stackPointer;
+        target.programCounter = &programmCounter;
+        target.exit = &m_jitExit;
+        m_jit = std::make_unique<JitCompiler>(target);
+    }
+    if (backend == CpuBackend::JIT && !m_jit->available()) backend = CpuBackend::DECODED_BLOCKS;
+#endif
+
+    //Watched pages would keep taking the slow write path for nothing
+    if (backend == CpuBackend::INTERPRETER) invalidateWritableCode();
+    m_blockNext = m_blockEnd = nullptr;
+    m_backend = backend;
+}
+
+bool Cpu::continueBlock()
+{
+    if (m_blockNext == m_blockEnd || programmCounter != m_blockAddress) return false;
+
+    currentInstruction = *m_blockNext++;
+    m_blockAddress += currentInstruction.length;
+    return true;
+}
+
+Cpu::CodeBlock* Cpu::enterBlock()
+{
+    const uint8_t* code = m_memoryMap->codePointer(programmCounter);
+    if (!code)
+    {
+        m_blockNext = m_blockEnd = nullptr;
+        return nullptr;
+    }
+
+    BlockLookup& lookup = m_blockLookup[blockLookupIndex(code)];
+    if (lookup.code != code)
+    {
+        auto blockIt = m_blocks.find(code);
+        lookup.code = code;
+        lookup.block = blockIt != m_blocks.end() ? &blockIt->second : &decodeBlock(code);
+    }
+    CodeBlock& block = *lookup.block;
+    detectIdleLoop(block);
+
+    //Empty if the first instruction crosses into the next page, that one is decoded every time
+    m_blockNext = block.instructions.data();
+    m_blockEnd = block.instructions.data() + block.instructions.size();
+    m_blockAddress = programmCounter;
+    return &block;
+}
+
+#ifdef GBEMU_JIT
+
+bool Cpu::canRunCompiled(CodeBlock& block)
+{
+    if (!block.compiled.translated)
+    {
+        if (!block.readOnly)
+        {
+            block.compiled.translated = true;
+        }
+        else if (!m_jit->compile(block.compiled, programmCounter, block.instructions.data(), block.instructions.size()))
+        {
+            //The cache is full, everything is compiled again when it is entered next
+            for (auto& entry : m_blocks) entry.second.compiled = {};
+            m_jit->clear();
+            m_jit->compile(block.compiled, programmCounter, block.instructions.data(), block.instructions.size());
+        }
+    }
+
+    Scheduler& scheduler = m_scheduler;
+    return block.compiled.code && block.compiled.address == programmCounter
+        && scheduler.now() + block.compiled.cycles < std::min(m_runLimit, scheduler.nextDeadline());
+}
+
+uint8_t Cpu::runCompiled(const CodeBlock& block)
+{
+    Scheduler& scheduler = m_scheduler;
+
+    //F is read and written directly by the compiled code
+    statusRegister.flush();
+    m_jitLimit = scheduler.now() + block.compiled.cycles;
+    m_jitAdvanced = 0;
+    m_jitExit = false;
+
+    JitExit exit = m_jit->run(block.compiled);
+    scheduler.advance(exit.offset - m_jitAdvanced);
+
+    //The rest of the block continues decoded, unless its code was remapped in between
+    m_blockNext = block.instructions.data() + exit.instructions;
+    if (!m_blockEnd) m_blockEnd = m_blockNext;
+    m_blockAddress = exit.address;
+    return exit.cycles;
+}
+
+uint8_t Cpu::compiledRead(void* context, uint16_t address, uint32_t cycles)
+{
+    Cpu& cpu = *(Cpu*)context;
+    cpu.syncCompiled(cycles);
+    uint8_t value = cpu.m_memoryMap->readMemoryBus(address);
+    cpu.checkCompiledExit();
+    return value;
+}
+
+void Cpu::compiledWrite(void* context, uint16_t address, uint8_t value, uint32_t cycles)
+{
+    Cpu& cpu = *(Cpu*)context;
+    cpu.syncCompiled(cycles);
+    cpu.m_memoryMap->writeMemoryBus(address, value);
+    cpu.checkCompiledExit();
+}
+
+void Cpu::syncCompiled(uint32_t cycles)
+{
+    //No event is due before the last instruction, so this only moves the time
+    m_scheduler.get().advance(cycles - m_jitAdvanced);
+    m_jitAdvanced = cycles;
+}
+
+void Cpu::checkCompiledExit()
+{
+    //An event or an interrupt check now falls into the block, or the mapping changed under it
+    Scheduler& scheduler = m_scheduler;
+    if (std::min(m_runLimit, scheduler.nextDeadline()) <= m_jitLimit || !m_blockEnd) m_jitExit = true;
+}
+
+#endif
+
+//Instructions that neither write memory nor touch the stack, IME or HALT, so a loop made
+//of them only depends on the registers and on what it reads
+static bool isSideEffectFree(uint16_t opCode)
+{
+    if ((opCode >> 8) == 0xCB)
+    {
+        //Of the operations on (HL) only BIT does not write it back
+        return (opCode & 0x07) != 0x06 || (opCode & 0xC0) == 0x40;
+    }
+
+    //Loads between registers and the ALU, except LD (HL),r and HALT
+    if (opCode >= 0x40 && opCode <= 0xBF) return (opCode & 0xF8) != 0x70;
+
+    switch (opCode)
+    {
+        case 0x00:
+        case 0x01: case 0x11: case 0x21:
+        case 0x03: case 0x0B: case 0x13: case 0x1B: case 0x23: case 0x2B:
+        case 0x04: case 0x05: case 0x0C: case 0x0D: case 0x14: case 0x15: case 0x1C: case 0x1D:
+        case 0x24: case 0x25: case 0x2C: case 0x2D: case 0x3C: case 0x3D:
+        case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E:
+        case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x27: case 0x2F: case 0x37: case 0x3F:
+        case 0x09: case 0x19: case 0x29:
+        case 0x0A: case 0x1A: case 0x2A: case 0x3A:
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+        case 0xF0: case 0xF2: case 0xFA:
+            return true;
+    }
+    return false;
+}
+
+Cpu::CodeBlock& Cpu::decodeBlock(const uint8_t* code)
+{
+    CodeBlock& block = m_blocks[code];
+    bool writable = m_memoryMap->watchCodePage(programmCounter);
+    if (writable) m_writableBlocks[programmCounter >> 8].push_back(code);
+#ifdef GBEMU_JIT
+    block.readOnly = !writable;
+#endif
+
+    //Instructions crossing the page end may continue in another bank
+    uint16_t available = PAGE_SIZE - (programmCounter & (PAGE_SIZE - 1));
+    while (block.instructions.size() < BLOCK_MAX_INSTRUCTIONS)
+    {
+        uint16_t opCode = code[0];
+        if (opCode == 0xCB)
+        {
+            if (available < 2) break;
+            opCode = (opCode << 8) | code[1];
+        }
+
+        Instructions::Instruction instruction = Instructions::getInstruction(opCode);
+        if (instruction.length > available) break;
+
+        //Same as decode()
+        if (instruction.length == 2) instruction.operant = code[1];
+        if (instruction.length == 3) instruction.operant = ((instruction.operant | code[2]) << 8) | code[1];
+
+        if (block.sideEffectFree == block.instructions.size() && isSideEffectFree(opCode)) block.sideEffectFree++;
+        block.instructions.push_back(instruction);
+        code += instruction.length;
+        available -= instruction.length;
+
+        //Unconditional jumps, returns and HALT, the code after them may not be code at all
+        switch (opCode)
+        {
+            case 0x10: case 0x18: case 0x76: case 0xC3: case 0xC9: case 0xD9: case 0xE9:
+            case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+                return block;
+        }
+    }
+    return block;
+}
+
+void Cpu::detectIdleLoop(const CodeBlock& block)
+{
+    //The loop ran from the start of the block back to it, without leaving it in between
+    bool isLoop = &block == m_block && programmCounter == m_blockStart
+        && m_blockNext > block.instructions.data() && m_blockNext <= block.instructions.data() + block.sideEffectFree;
+
+    m_block = &block;
+    m_blockStart = programmCounter;
+
+    //Most block entries are no loop, only loops pay for the flags and the register copy
+    if (!isLoop)
+    {
+        m_hasBlockRegisters = false;
+        return;
+    }
+
+    statusRegister.flush();
+    if (m_hasBlockRegisters && memcmp(&gpRegister, m_blockRegisters, sizeof(m_blockRegisters)) == 0 && stackPointer == m_blockStackPointer)
+    {
+        for (const Instructions::Instruction* instruction = block.instructions.data(); instruction != m_blockNext; instruction++)
+        {
+            m_idleLoopCycles += instruction->cycles;
+        }
+        m_runLimit = 0;
+    }
+
+    m_hasBlockRegisters = true;
+    memcpy(m_blockRegisters, &gpRegister, sizeof(m_blockRegisters));
+    m_blockStackPointer = stackPointer;
+}
+
+void Cpu::invalidateCode(uint16_t address)
+{
+    std::vector<const uint8_t*>& blocks = m_writableBlocks[address >> 8];
+    for (const uint8_t* code : blocks)
+    {
+        m_blocks.erase(code);
+
+        BlockLookup& lookup = m_blockLookup[blockLookupIndex(code)];
+        if (lookup.code == code) lookup = {};
+    }
+    blocks.clear();
+
+    m_blockNext = m_blockEnd = nullptr;
+    m_memoryMap->unwatchCodePage(address);
+}
+
+void Cpu::invalidateWritableCode()
+{
+    for (uint32_t address = 0; address < HIGH_AREA_ADDRESS; address += PAGE_SIZE)
+    {
+        if (!m_writableBlocks[address >> 8].empty()) invalidateCode(address);
+    }
+    m_blockNext = m_blockEnd = nullptr;
+}
+
 void Cpu::fetch()
 {
     currentOpCode = m_memoryMap->readMemoryBus(programmCounter);
@@ -68,9 +453,42 @@ void Cpu::decode()
 void Cpu::execute()
 {
     programmCounter += currentInstruction.length;
-    
+
+#ifdef GBEMU_DISPATCH_TABLE
+    uint16_t operation = currentInstruction.operation;
+    if ((operation >> 8) == 0xCB)
+        (this->*s_cbOperationTable[operation & 0xFF])();
+    else
+        (this->*s_operationTable[operation & 0xFF])();
+#else
+    executeOperation(currentInstruction.operation);
+#endif
+}
+
+#ifdef GBEMU_DISPATCH_TABLE
+
+template<uint16_t t_operation>
+void Cpu::operationHandler()
+{
+    //the operation is a constant here, so the switch folds down to the single case
+    executeOperation(t_operation);
+}
+
+template<uint16_t t_prefix, size_t... t_opCodes>
+constexpr Cpu::OperationTable Cpu::makeOperationTable(std::index_sequence<t_opCodes...>)
+{
+    return {{ &Cpu::operationHandler<t_prefix | t_opCodes>... }};
+}
+
+const Cpu::OperationTable Cpu::s_operationTable = Cpu::makeOperationTable<0x00>(std::make_index_sequence<256>());
+const Cpu::OperationTable Cpu::s_cbOperationTable = Cpu::makeOperationTable<0xCB00>(std::make_index_sequence<256>());
+
+#endif
+
+GBEMU_ALWAYS_INLINE void Cpu::executeOperation(uint16_t operation)
+{
     //Don't worry, I generated most of this switch with python
-    switch(currentInstruction.operation)
+    switch(operation)
     {
         case 0x00:
             break;
@@ -252,6 +670,13 @@ void Cpu::execute()
             break;
         
         case 0x27:
+#ifdef GBEMU_ALU_TABLES
+        {
+            uint16_t entry = AluTables::DAA_TABLE[((statusRegister.getStatusRegister() & 0x70) << 4) | gpRegister.registerA];
+            gpRegister.registerA = (uint8_t)entry;
+            statusRegister.assignFlags(entry >> 8);
+        }
+#else
             if (!statusRegister.isNegativFlagSet()) 
             {  
 
@@ -283,6 +708,7 @@ void Cpu::execute()
             }
             statusRegister.checkZeroFlag(gpRegister.registerA);
             statusRegister.resetHalfCarryFlag();
+#endif
             break;
 
         case 0x28:
@@ -637,6 +1063,7 @@ void Cpu::execute()
 
         case 0x76:
             m_isHalted = true;
+            m_runLimit = 0;
             break;
 
         case 0x77:
@@ -1160,6 +1587,7 @@ void Cpu::execute()
             break;
 
         case 0xF1:
+            statusRegister.discard();
             gpRegister.registerF = m_memoryMap->readMemoryBus(stackPointer);
             gpRegister.registerF &= 0xF0;
             stackPointer++;
@@ -1180,7 +1608,7 @@ void Cpu::execute()
             stackPointer--;
             m_memoryMap->writeMemoryBus(stackPointer, gpRegister.registerA);
             stackPointer--;
-            m_memoryMap->writeMemoryBus(stackPointer, gpRegister.registerF);
+            m_memoryMap->writeMemoryBus(stackPointer, statusRegister.getStatusRegister());
             break;
 
         case 0xF6:
@@ -2347,18 +2775,20 @@ void Cpu::execute()
 
         //TODO Implement STOP
         default:
-            printf("Unsupported OpCode %d, HALT", currentInstruction.operation);
+            printf("Unsupported OpCode %d, HALT", operation);
             //assert(false);
     }   
 }
 
 void Cpu::add8Bit(uint8_t operant)
 {
-    statusRegister.checkCarryFlag8BitAdd(gpRegister.registerA, operant);
-    statusRegister.checkHalfCarryFlag8BitAdd(gpRegister.registerA, operant);
-    statusRegister.resetNegativFlag();
-    statusRegister.checkZeroFlag(gpRegister.registerA + operant);
-    gpRegister.registerA += operant;
+    uint16_t result = gpRegister.registerA + operant;
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::ADD_FLAGS[AluTables::flagIndex(gpRegister.registerA, operant, result)]);
+#else
+    statusRegister.setFlags(FlagOperation::ADD, gpRegister.registerA, operant, result);
+#endif
+    gpRegister.registerA = (uint8_t)result;
 }
 
 void Cpu::add16Bit(uint16_t operant)
@@ -2373,21 +2803,24 @@ void Cpu::addCarry8Bit(uint8_t operant)
 {   
     uint8_t carry = statusRegister.isCarryFlagSet() ? 1 : 0;
     uint16_t result = gpRegister.registerA + operant + carry;
-    statusRegister.resetNegativFlag();
-    statusRegister.checkZeroFlag(result & 0xFF);
-    (gpRegister.registerA ^ operant ^ result) & 0x10 ? statusRegister.setHalfCarryFlag() : statusRegister.resetHalfCarryFlag();
-    (result & 0xFF00) ? statusRegister.setCarryFlag() : statusRegister.resertCarryFlag();
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::ADD_FLAGS[AluTables::flagIndex(gpRegister.registerA, operant, result)]);
+#else
+    statusRegister.setFlags(FlagOperation::ADD, gpRegister.registerA, operant, result);
+#endif
     gpRegister.registerA = result & 0xFF;
 }
 
 
 void Cpu::sub8Bit(uint8_t operant)
 {
-    statusRegister.checkCarryFlag8BitSub(gpRegister.registerA, operant);
-    statusRegister.checkHalfCarryFlag8BitSub(gpRegister.registerA, operant);
-    statusRegister.setNegativFlag();
-    gpRegister.registerA -= operant;
-    statusRegister.checkZeroFlag(gpRegister.registerA);
+    uint16_t result = gpRegister.registerA - operant;
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::SUB_FLAGS[AluTables::flagIndex(gpRegister.registerA, operant, result)]);
+#else
+    statusRegister.setFlags(FlagOperation::SUB, gpRegister.registerA, operant, result);
+#endif
+    gpRegister.registerA = (uint8_t)result;
 }
 
 void Cpu::sub16Bit(uint16_t operant)
@@ -2403,69 +2836,59 @@ void Cpu::subCarry8Bit(uint8_t operant)
 {
     uint8_t carry = statusRegister.isCarryFlagSet() ? 1 : 0;
     uint16_t result = gpRegister.registerA - operant - carry;
-    statusRegister.setNegativFlag();
-    statusRegister.checkZeroFlag(result & 0xFF);
-    (gpRegister.registerA ^ operant ^ result) & 0x10 ? statusRegister.setHalfCarryFlag() : statusRegister.resetHalfCarryFlag();
-    (result & 0xFF00) ? statusRegister.setCarryFlag() : statusRegister.resertCarryFlag();
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::SUB_FLAGS[AluTables::flagIndex(gpRegister.registerA, operant, result)]);
+#else
+    statusRegister.setFlags(FlagOperation::SUB, gpRegister.registerA, operant, result);
+#endif
     gpRegister.registerA = result & 0xFF;
 }
 
 void Cpu::and8Bit(uint8_t operant)
 {
-    statusRegister.resetNegativFlag();
-    statusRegister.resertCarryFlag();
-    statusRegister.setHalfCarryFlag();
     gpRegister.registerA &= operant;
-    statusRegister.checkZeroFlag(gpRegister.registerA);
+    statusRegister.setFlags(FlagOperation::AND, gpRegister.registerA, operant, gpRegister.registerA);
 }
 
 void Cpu::or8Bit(uint8_t operant)
 {
-    statusRegister.resetNegativFlag();
-    statusRegister.resetHalfCarryFlag();
-    statusRegister.resertCarryFlag();
     gpRegister.registerA |= operant;
-    statusRegister.checkZeroFlag(gpRegister.registerA);
+    statusRegister.setFlags(FlagOperation::OR, gpRegister.registerA, operant, gpRegister.registerA);
 }
 
 void Cpu::xor8Bit(uint8_t operant)
 {
-    statusRegister.resetNegativFlag();
-    statusRegister.resetHalfCarryFlag();
-    statusRegister.resertCarryFlag();
     gpRegister.registerA ^= operant;
-    statusRegister.checkZeroFlag(gpRegister.registerA);
+    statusRegister.setFlags(FlagOperation::XOR, gpRegister.registerA, operant, gpRegister.registerA);
 }
 
 void Cpu::compare8Bit(uint8_t operant)
 {
-    statusRegister.setNegativFlag();
-    if (gpRegister.registerA - operant == 0)
-    {
-        statusRegister.checkZeroFlag(0);
-    }
-    else
-    {
-        statusRegister.resetZeroFlag();
-    }
-    statusRegister.checkCarryFlag8BitSub(gpRegister.registerA, operant);
-    statusRegister.checkHalfCarryFlag8BitSub(gpRegister.registerA, operant);
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::SUB_FLAGS[AluTables::flagIndex(gpRegister.registerA, operant, gpRegister.registerA - operant)]);
+#else
+    statusRegister.setFlags(FlagOperation::SUB, gpRegister.registerA, operant, gpRegister.registerA - operant);
+#endif
 }
 
 void Cpu::increment8Bit(uint8_t& operant)
 {
-    statusRegister.checkHalfCarryFlag8BitAdd(operant, 1);
-    statusRegister.resetNegativFlag();
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::INC_FLAGS[operant] | (statusRegister.isCarryFlagSet() ? RegisterFlag::CARRY_FLAG : 0));
+#else
+    statusRegister.setFlags(FlagOperation::INC, operant, 1, operant + 1);
+#endif
     operant++;
-    statusRegister.checkZeroFlag(operant);
 }
 
 void Cpu::decrement8Bit(uint8_t& operant)
 {
-    statusRegister.checkHalfCarryFlag8BitSub(operant, 1);
-    statusRegister.setNegativFlag();
+#ifdef GBEMU_ALU_TABLES
+    statusRegister.assignFlags(AluTables::DEC_FLAGS[operant] | (statusRegister.isCarryFlagSet() ? RegisterFlag::CARRY_FLAG : 0));
+#else
+    statusRegister.setFlags(FlagOperation::DEC, operant, 1, operant - 1);
+#endif
     operant--;
-    statusRegister.checkZeroFlag(operant);
 }
 
 void Cpu::swap(uint8_t& operant)
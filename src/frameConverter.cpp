@@ -0,0 +1,64 @@
+#include "../include/Peripheral/frameConverter.hpp"
+
+#include <cstring>
+
+//Gray level of each DMG shade
+static constexpr uint8_t GRAY_LEVELS[4] = { 0xFF, 0xCC, 0x77, 0x00 };
+
+static constexpr uint16_t rgb565(uint8_t gray)
+{
+    return ((gray >> 3) << 11) | ((gray >> 2) << 5) | (gray >> 3);
+}
+
+void FrameConverter::convert(const uint8_t* shades, size_t pixelCount, PixelFormat format, void* destination)
+{
+    uint8_t* out = (uint8_t*)destination;
+
+    switch(format)
+    {
+        case PixelFormat::GRAYSCALE:
+        {
+            for (size_t i = 0; i < pixelCount; i++)
+            {
+                out[i] = GRAY_LEVELS[shades[i] & 0x3];
+            }
+            break;
+        }
+
+        case PixelFormat::RGB888:
+        {
+            for (size_t i = 0; i < pixelCount; i++)
+            {
+                out[i * 3] = out[i * 3 + 1] = out[i * 3 + 2] = GRAY_LEVELS[shades[i] & 0x3];
+            }
+            break;
+        }
+
+        case PixelFormat::RGBA8888:
+        {
+            static constexpr uint8_t RGBA[4][4] = {
+                { GRAY_LEVELS[0], GRAY_LEVELS[0], GRAY_LEVELS[0], 0xFF },
+                { GRAY_LEVELS[1], GRAY_LEVELS[1], GRAY_LEVELS[1], 0xFF },
+                { GRAY_LEVELS[2], GRAY_LEVELS[2], GRAY_LEVELS[2], 0xFF },
+                { GRAY_LEVELS[3], GRAY_LEVELS[3], GRAY_LEVELS[3], 0xFF }
+            };
+            for (size_t i = 0; i < pixelCount; i++)
+            {
+                memcpy(out + i * 4, RGBA[shades[i] & 0x3], 4);
+            }
+            break;
+        }
+
+        case PixelFormat::RGB565:
+        {
+            static constexpr uint16_t RGB565[4] = {
+                rgb565(GRAY_LEVELS[0]), rgb565(GRAY_LEVELS[1]), rgb565(GRAY_LEVELS[2]), rgb565(GRAY_LEVELS[3])
+            };
+            for (size_t i = 0; i < pixelCount; i++)
+            {
+                memcpy(out + i * 2, &RGB565[shades[i] & 0x3], 2);
+            }
+            break;
+        }
+    }
+}
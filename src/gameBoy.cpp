@@ -0,0 +1,215 @@
+#include "../include/gameBoy.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+GameBoy::GameBoy(std::unique_ptr<Peripheral> cartridge) :
+    m_cartridge(std::move(cartridge)),
+    m_lcdStatus(m_interruptController),
+    m_ppu(m_interruptController, m_lcdStatus, m_scheduler),
+    m_cpu(m_interruptController, m_memoryBus, m_scheduler),
+    m_timer(m_interruptController, m_scheduler),
+    m_controller(m_interruptController)
+{
+    m_memoryBus.registerPeripheral(&m_socRam);
+    m_memoryBus.registerPeripheral(&m_ppu);
+    m_memoryBus.registerPeripheral(&m_apu);
+    m_memoryBus.registerPeripheral(&m_lcdStatus);
+    m_memoryBus.registerPeripheral(m_cartridge.get());
+    m_memoryBus.registerPeripheral(&m_timer);
+    m_memoryBus.registerPeripheral(&m_interruptController);
+    m_memoryBus.registerPeripheral(&m_serial);
+    m_memoryBus.registerPeripheral(&m_controller);
+
+    m_ppu.registerDmaHandler([this](const uint16_t _address, uint8_t& value)
+    {
+        uint16_t address = value * 0x100;
+        for (int i = 0; i < OAM_SIZE; i++)
+        {
+            uint8_t ramValue = m_memoryBus.readMemoryBus(address + i);
+            m_ppu.objectAttributeMemory()[i] = ramValue;
+        }
+    });
+
+    //While run-ahead is active the real frames draw only to be continued ahead
+    m_ppu.setFrameCompleteHandler([this]()
+    {
+        if (m_frameCompleteHandler && (m_runAheadActive == 0 || m_speculative)) m_frameCompleteHandler();
+    });
+
+    StateArchive sizeArchive;
+    serialize(sizeArchive);
+    m_stateSize = sizeArchive.position();
+}
+
+void GameBoy::runFrame()
+{
+    if (m_runAheadFrames == 0)
+    {
+        emulateFrame();
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (m_runAheadActive == 0) emulateFrame();
+    else runAheadFrame();
+    adjustRunAhead(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void GameBoy::runAheadFrame()
+{
+    //A frame drawn in a runFrame() starts in the one before, so only the last two are drawn
+    m_ppu.setRenderPolicy(m_runAheadActive == 1 ? RenderPolicy::ALL : RenderPolicy::NEVER);
+    emulateFrame();
+    snapshot(m_runAheadState);
+    //Not part of the state, without it the next frame would draw with the decision of the last frame ahead
+    PictureProcessingUnit::RenderState renderState = m_ppu.renderState();
+
+    m_speculative = true;
+    for (unsigned frame = 1; frame <= m_runAheadActive; frame++)
+    {
+        if (frame + 1 == m_runAheadActive) m_ppu.setRenderPolicy(RenderPolicy::ALL);
+        emulateFrame();
+    }
+    m_speculative = false;
+
+    //The frame buffer is not part of the state and keeps the frame ahead
+    restore(m_runAheadState);
+    m_ppu.setRenderState(renderState);
+}
+
+void GameBoy::adjustRunAhead(double seconds)
+{
+    const double budget = (double)CYCLES_PER_FRAME / CPU_FREQUENCY;
+    m_runAheadCost += (seconds - m_runAheadCost) / 16;
+
+    if (m_runAheadCost > budget && m_runAheadActive > 0)
+    {
+        //Estimate of the cost with one frame less
+        m_runAheadCost = m_runAheadCost * m_runAheadActive / (m_runAheadActive + 1);
+        m_runAheadActive--;
+        m_runAheadRecovery = 0;
+        if (m_runAheadActive == 0) m_ppu.setRenderPolicy(m_renderPolicy, m_renderInterval);
+    }
+    else if (m_runAheadActive < m_runAheadFrames && m_runAheadCost * (m_runAheadActive + 2) / (m_runAheadActive + 1) < budget / 2)
+    {
+        if (++m_runAheadRecovery >= RUN_AHEAD_RECOVERY_FRAMES)
+        {
+            m_runAheadActive++;
+            m_runAheadRecovery = 0;
+        }
+    }
+    else
+    {
+        m_runAheadRecovery = 0;
+    }
+}
+
+void GameBoy::setRunAhead(unsigned frames)
+{
+    m_runAheadFrames = frames;
+    m_runAheadActive = frames;
+    m_runAheadCost = 0;
+    m_runAheadRecovery = 0;
+    if (frames == 0) m_ppu.setRenderPolicy(m_renderPolicy, m_renderInterval);
+}
+
+void GameBoy::setRenderPolicy(RenderPolicy policy, unsigned interval)
+{
+    m_renderPolicy = policy;
+    m_renderInterval = interval;
+    if (m_runAheadActive == 0) m_ppu.setRenderPolicy(policy, interval);
+}
+
+void GameBoy::emulateFrame()
+{
+    m_frameEnd += CYCLES_PER_FRAME;
+
+    //PPU and timer only run when one of their deadlines is reached, the CPU stops at
+    //the cycle of each input event so it is applied at the same point on every run
+    uint64_t nextInput = applyInput();
+    if (m_frameStartHandler && !m_speculative) m_frameStartHandler();
+    //The handler may have changed the joypad or the whole machine
+    m_scheduler.markChange();
+
+    while (m_scheduler.now() < m_frameEnd)
+    {
+        m_cpu.runUntil(std::min(m_frameEnd, nextInput));
+        nextInput = applyInput();
+    }
+
+    m_frameCount++;
+}
+
+uint64_t GameBoy::applyInput()
+{
+    //Frames ahead of the machine run with the input as it is
+    if (m_speculative) return Scheduler::NEVER;
+
+    const InputEvent* event;
+    while ((event = m_inputQueue.front()) && event->cycle <= m_scheduler.now())
+    {
+        if (event->kind == InputKind::BUTTON)
+        {
+            if (event->pressed) m_controller.buttonPressed((Button)event->key);
+            else m_controller.buttonReleased((Button)event->key);
+        }
+        else
+        {
+            if (event->pressed) m_controller.dpadPressed((Dpad)event->key);
+            else m_controller.dpadReleased((Dpad)event->key);
+        }
+        m_inputQueue.pop();
+        m_scheduler.markChange();
+    }
+    return event ? event->cycle : Scheduler::NEVER;
+}
+
+void GameBoy::snapshot(std::vector<uint8_t>& state)
+{
+    StateArchive archive(state);
+    serialize(archive);
+    archive.finish();
+}
+
+bool GameBoy::restore(const std::vector<uint8_t>& state)
+{
+    //Every section has a fixed size, a state of another layout is rejected before anything is written
+    if (state.size() != m_stateSize) return false;
+
+    StateArchive archive(state.data(), state.size());
+    serialize(archive);
+    return !archive.overrun() && archive.position() == state.size();
+}
+
+void GameBoy::serialize(StateArchive& archive)
+{
+    for (uint32_t section = 0; section < (uint32_t)StateSection::SECTION_COUNT; section++)
+    {
+        serializeSection((StateSection)section, archive);
+    }
+}
+
+void GameBoy::serializeSection(StateSection section, StateArchive& archive)
+{
+    switch(section)
+    {
+        case StateSection::MACHINE:
+            archive.value(m_frameEnd);
+            archive.value(m_frameCount);
+            break;
+        case StateSection::SCHEDULER: m_scheduler.serialize(archive); break;
+        case StateSection::CPU: m_cpu.serialize(archive); break;
+        case StateSection::INTERRUPT: m_interruptController.serialize(archive); break;
+        case StateSection::SOC_RAM: m_socRam.serialize(archive); break;
+        case StateSection::LCD_STATUS: m_lcdStatus.serialize(archive); break;
+        case StateSection::PPU: m_ppu.serialize(archive); break;
+        case StateSection::APU: m_apu.serialize(archive); break;
+        case StateSection::TIMER: m_timer.serialize(archive); break;
+        case StateSection::SERIAL: m_serial.serialize(archive); break;
+        case StateSection::CONTROLLER: m_controller.serialize(archive); break;
+        case StateSection::CARTRIDGE: m_cartridge->serialize(archive); break;
+        case StateSection::MEMORY_BUS: m_memoryBus.serialize(archive); break;
+        default: assert(false);
+    }
+}
@@ -0,0 +1,904 @@
+#include <array>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "../include/jitCompiler.hpp"
+
+//Host registers, numbered like in the ModRM byte
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RBX 3
+#define RSP 4
+#define RBP 5
+#define RSI 6
+#define RDI 7
+#define R12 12
+#define R13 13
+#define R14 14
+#define R15 15
+
+//Guest registers as numbered in the opcodes, F takes the place of (HL) when registers are loaded or stored
+#define GUEST_B 0
+#define GUEST_C 1
+#define GUEST_D 2
+#define GUEST_E 3
+#define GUEST_H 4
+#define GUEST_L 5
+#define GUEST_F 6
+#define GUEST_A 7
+#define GUEST_MEMORY 6
+
+//Host registers of the guest state, all callee saved so they survive the bus handlers
+#define HOST_A R12
+#define HOST_F RBX
+#define HOST_BC R13
+#define HOST_DE R14
+#define HOST_HL R15
+#define HOST_SP RBP
+
+//Condition codes of Jcc and SETcc
+#define CONDITION_ZERO 0x4
+#define CONDITION_NOT_ZERO 0x5
+#define CONDITION_ALWAYS 0xFF
+
+//Offsets into JitTarget::registers
+#define OFFSET_A 0
+#define OFFSET_B 1
+#define OFFSET_C 2
+#define OFFSET_D 3
+#define OFFSET_E 4
+#define OFFSET_F 5
+#define OFFSET_H 6
+#define OFFSET_L 7
+
+namespace
+{
+    //Z, H and C of the guest from the host flags LAHF leaves in AH: SF ZF 0 AF 0 PF 1 CF
+    constexpr std::array<uint8_t, 256> makeFlagTable()
+    {
+        std::array<uint8_t, 256> table = {};
+        for (int flags = 0; flags < 256; flags++)
+        {
+            table[flags] = (flags & 0x40 ? 0x80 : 0) | (flags & 0x10 ? 0x20 : 0) | (flags & 0x01 ? 0x10 : 0);
+        }
+        return table;
+    }
+
+    const std::array<uint8_t, 256> FLAG_TABLE = makeFlagTable();
+
+    //Host register holding the 16-bit pair of rr in LD rr,nn, INC rr, DEC rr and ADD HL,rr
+    uint8_t pairHost(uint8_t pair)
+    {
+        static const uint8_t hosts[4] = { HOST_BC, HOST_DE, HOST_HL, HOST_SP };
+        return hosts[pair & 3];
+    }
+
+    //Whether control never continues after the instruction within the block
+    bool endsBlock(uint16_t operation)
+    {
+        switch (operation)
+        {
+            case 0x18: case 0xC3: case 0xE9: case 0xCD: case 0xC9:
+            case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+                return true;
+        }
+        return false;
+    }
+}
+
+JitCompiler::JitCompiler(const JitTarget& target) : m_target(target)
+{
+    void* cache = mmap(nullptr, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) return;
+
+    m_cache = (uint8_t*)cache;
+    emitTrampoline();
+    m_trampolineSize = m_used;
+    if (mprotect(m_cache, JIT_CACHE_SIZE, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(m_cache, JIT_CACHE_SIZE);
+        m_cache = nullptr;
+    }
+}
+
+JitCompiler::~JitCompiler()
+{
+    if (m_cache) munmap(m_cache, JIT_CACHE_SIZE);
+}
+
+void JitCompiler::clear()
+{
+    m_used = m_trampolineSize;
+}
+
+bool JitCompiler::compile(JitBlock& block, uint16_t address, const Instructions::Instruction* instructions, size_t count)
+{
+    if (m_used + JIT_BLOCK_RESERVE > JIT_CACHE_SIZE) return false;
+
+    //Never writable and executable at the same time
+    mprotect(m_cache, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE);
+
+    size_t start = m_used;
+    uint16_t programCounter = address;
+    uint32_t offset = 0;
+    uint32_t lastOffset = 0;
+    uint8_t lastCycles = 0;
+    size_t translated = 0;
+    bool ended = false;
+    while (translated < count && !ended)
+    {
+        const Instructions::Instruction& instruction = instructions[translated];
+        if (!compileInstruction(instruction, programCounter, offset, translated + 1)) break;
+
+        translated++;
+        lastOffset = offset;
+        lastCycles = instruction.cycles;
+        programCounter += instruction.length;
+        offset += instruction.cycles;
+        ended = endsBlock(instruction.operation);
+    }
+    //Entering and leaving the code costs more than decoding a few instructions
+    if (translated < JIT_MIN_INSTRUCTIONS) translated = 0;
+    else if (!ended) emitExit(programCounter, translated, lastOffset, lastCycles, programCounter);
+
+    mprotect(m_cache, JIT_CACHE_SIZE, PROT_READ | PROT_EXEC);
+
+    block.translated = true;
+    block.address = address;
+    block.cycles = lastOffset;
+    block.code = translated ? m_cache + start : nullptr;
+    if (!translated) m_used = start;
+    return true;
+}
+
+void JitCompiler::emitTrampoline()
+{
+    //push rbx, rbp, r12 to r15 and keep the stack aligned for the handler calls, [rsp] is scratch
+    emit({ 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x48, 0x83, 0xEC, 0x08 });
+
+    auto loadByte = [&](uint8_t host, uint8_t offset) {
+        //movzx host, byte [rax + offset]
+        emitRex(false, host, RAX);
+        emit({ 0x0F, 0xB6, (uint8_t)(0x40 | (host & 7) << 3), offset });
+    };
+    auto loadPair = [&](uint8_t host, uint8_t highOffset, uint8_t lowOffset) {
+        loadByte(host, highOffset);
+        emitShift(4, host, 8);
+        loadByte(RCX, lowOffset);
+        emitRegister(0x09, RCX, host);
+    };
+
+    emitMoveImmediate64(RAX, (uint64_t)m_target.registers);
+    loadByte(HOST_A, OFFSET_A);
+    loadByte(HOST_F, OFFSET_F);
+    loadPair(HOST_BC, OFFSET_B, OFFSET_C);
+    loadPair(HOST_DE, OFFSET_D, OFFSET_E);
+    loadPair(HOST_HL, OFFSET_H, OFFSET_L);
+    //movzx ebp, word [rax]
+    emitMoveImmediate64(RAX, (uint64_t)m_target.stackPointer);
+    emit({ 0x0F, 0xB7, 0x28 });
+    //jmp rdi
+    emit({ 0xFF, 0xE7 });
+
+    //Every exit jumps here with the program counter in esi and the packed JitExit in rdx
+    m_exit = m_cache + m_used;
+
+    auto storeByte = [&](uint8_t host, uint8_t offset) {
+        //mov byte [rax + offset], host
+        emitRex(false, host, RAX, true);
+        emit({ 0x88, (uint8_t)(0x40 | (host & 7) << 3), offset });
+    };
+    auto storePair = [&](uint8_t host, uint8_t highOffset, uint8_t lowOffset) {
+        storeByte(host, lowOffset);
+        emitShift(5, host, 8);
+        storeByte(host, highOffset);
+    };
+
+    emitMoveImmediate64(RAX, (uint64_t)m_target.registers);
+    storeByte(HOST_A, OFFSET_A);
+    storeByte(HOST_F, OFFSET_F);
+    storePair(HOST_BC, OFFSET_B, OFFSET_C);
+    storePair(HOST_DE, OFFSET_D, OFFSET_E);
+    storePair(HOST_HL, OFFSET_H, OFFSET_L);
+    //mov word [rax], bp and mov word [rax], si
+    emitMoveImmediate64(RAX, (uint64_t)m_target.stackPointer);
+    emit({ 0x66, 0x89, 0x28 });
+    emitMoveImmediate64(RAX, (uint64_t)m_target.programCounter);
+    emit({ 0x66, 0x89, 0x30 });
+    //mov rax, rdx
+    emit({ 0x48, 0x89, 0xD0 });
+
+    emit({ 0x48, 0x83, 0xC4, 0x08, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3 });
+
+    m_enter = (EnterFunction)m_cache;
+}
+
+bool JitCompiler::compileInstruction(const Instructions::Instruction& instruction, uint16_t address, uint32_t offset, uint8_t executed)
+{
+    uint16_t operation = instruction.operation;
+    uint16_t operant = instruction.operant;
+    uint8_t cycles = instruction.cycles;
+    uint16_t next = address + instruction.length;
+
+    //Condition of JR, JP, CALL and RET cc: NZ, Z, NC, C. The jump skips the taken path.
+    auto emitSkipUnless = [&]() {
+        uint8_t condition = (operation >> 3) & 3;
+        emit({ 0xF6, 0xC3, (uint8_t)(condition < 2 ? 0x80 : 0x10) });
+        return emitJump(condition & 1 ? CONDITION_ZERO : CONDITION_NOT_ZERO);
+    };
+    auto emitIncrementPair = [&](uint8_t host, bool decrement) {
+        emitImmediate(decrement ? 5 : 0, host, 1);
+        emitZeroExtend16(host, host);
+    };
+    auto emitPop = [&]() {
+        emitMove(RSI, HOST_SP);
+        emitRead(offset);
+        emitIncrementPair(HOST_SP, false);
+    };
+    auto emitReturn = [&]() {
+        emitPop();
+        //mov [rsp], eax
+        emit({ 0x89, 0x04, 0x24 });
+        emitPop();
+        //shl eax, 8; or eax, [rsp]; mov esi, eax
+        emitShift(4, RAX, 8);
+        emit({ 0x0B, 0x04, 0x24 });
+        emitMove(RSI, RAX);
+        emitExit(0, executed, offset, cycles, next, true);
+    };
+
+    if ((operation >> 8) == 0xCB)
+    {
+        uint8_t code = operation & 0xFF;
+        uint8_t guest = code & 7;
+        uint8_t group = code >> 6;
+        uint8_t bit = (code >> 3) & 7;
+
+        if (guest == GUEST_MEMORY)
+        {
+            emitMove(RSI, HOST_HL);
+            emitRead(offset);
+            emitMove(RCX, RAX);
+        }
+        else
+        {
+            emitLoadRegister(guest, RCX);
+        }
+
+        switch (group)
+        {
+            case 0:
+            {
+                //RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+                static const uint8_t extensions[8] = { 0, 1, 2, 3, 4, 7, 0, 5 };
+                //bt ebx, 4 puts the carry into CF for RL and RR
+                if (bit == 2 || bit == 3) emit({ 0x0F, 0xBA, 0xE3, 0x04 });
+                emitShift(extensions[bit], RCX, bit == 6 ? 4 : 1, true);
+                emitRotateFlags(RCX, true, bit != 6);
+                break;
+            }
+            case 1:
+                //test cl, bit; setz al; movzx eax, al; shl eax, 7; or eax, H; F keeps C
+                emitExtended(0xF6, 0, RCX, true);
+                emit({ (uint8_t)(1 << bit), 0x0F, 0x94, 0xC0 });
+                emitZeroExtend8(RAX, RAX);
+                emitShift(4, RAX, 7);
+                emitImmediate(1, RAX, 0x20);
+                emitImmediate(4, HOST_F, 0x1F);
+                emitRegister(0x09, RAX, HOST_F);
+                break;
+            case 2:
+                emitExtended(0x80, 4, RCX, true);
+                emit({ (uint8_t)~(1 << bit) });
+                break;
+            case 3:
+                emitExtended(0x80, 1, RCX, true);
+                emit({ (uint8_t)(1 << bit) });
+                break;
+        }
+
+        if (group != 1)
+        {
+            if (guest == GUEST_MEMORY)
+            {
+                emitZeroExtend8(RDX, RCX);
+                emitMove(RSI, HOST_HL);
+                emitWrite(offset);
+            }
+            else
+            {
+                emitStoreRegister(guest, RCX);
+            }
+        }
+        if (guest == GUEST_MEMORY) emitExitCheck(next, executed, offset, cycles);
+        return true;
+    }
+
+    //LD r,r' and LD r,(HL), LD (HL),r, HALT is left to the caller
+    if (operation >= 0x40 && operation <= 0x7F)
+    {
+        if (operation == 0x76) return false;
+
+        uint8_t destination = (operation >> 3) & 7;
+        uint8_t source = operation & 7;
+        if (source == GUEST_MEMORY)
+        {
+            emitMove(RSI, HOST_HL);
+            emitRead(offset);
+            emitStoreRegister(destination, RAX);
+            emitExitCheck(next, executed, offset, cycles);
+        }
+        else if (destination == GUEST_MEMORY)
+        {
+            emitLoadRegister(source, RDX);
+            emitMove(RSI, HOST_HL);
+            emitWrite(offset);
+            emitExitCheck(next, executed, offset, cycles);
+        }
+        else if (destination != source)
+        {
+            emitLoadRegister(source, RCX);
+            emitStoreRegister(destination, RCX);
+        }
+        return true;
+    }
+
+    //ADD, ADC, SUB, SBC, AND, XOR, OR and CP with a register, (HL) or an immediate
+    if ((operation >= 0x80 && operation <= 0xBF) || (operation & 0xC7) == 0xC6)
+    {
+        uint8_t source = operation & 7;
+        bool memory = operation < 0xC0 && source == GUEST_MEMORY;
+        if (operation >= 0xC0)
+        {
+            emitMoveImmediate(RCX, operant & 0xFF);
+        }
+        else if (memory)
+        {
+            emitMove(RSI, HOST_HL);
+            emitRead(offset);
+            emitMove(RCX, RAX);
+        }
+        else
+        {
+            emitLoadRegister(source, RCX);
+        }
+
+        uint8_t alu = (operation >> 3) & 7;
+        //Host opcodes of the 8-bit operations in the order of the guest ones
+        static const uint8_t opCodes[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+        if (alu == 1 || alu == 3) emit({ 0x0F, 0xBA, 0xE3, 0x04 });
+        emitRegister(opCodes[alu], RCX, HOST_A, true);
+
+        switch (alu)
+        {
+            case 0: case 1: emitArithmeticFlags(0xB0, 0x00, 0x0F); break;
+            case 2: case 3: case 7: emitArithmeticFlags(0xB0, 0x40, 0x0F); break;
+            case 4: emitArithmeticFlags(0x80, 0x20, 0x0F); break;
+            default: emitArithmeticFlags(0x80, 0x00, 0x0F); break;
+        }
+        if (memory) emitExitCheck(next, executed, offset, cycles);
+        return true;
+    }
+
+    //INC r, DEC r and LD r,n
+    if ((operation & 0xC0) == 0x00 && (operation & 0x07) >= 0x04 && (operation & 0x07) <= 0x06)
+    {
+        uint8_t guest = (operation >> 3) & 7;
+        if ((operation & 0x07) == 0x06)
+        {
+            emitMoveImmediate(guest == GUEST_MEMORY ? RDX : RCX, operant & 0xFF);
+            if (guest == GUEST_MEMORY)
+            {
+                emitMove(RSI, HOST_HL);
+                emitWrite(offset);
+                emitExitCheck(next, executed, offset, cycles);
+            }
+            else
+            {
+                emitStoreRegister(guest, RCX);
+            }
+            return true;
+        }
+
+        bool decrement = operation & 0x01;
+        if (guest == GUEST_MEMORY)
+        {
+            emitMove(RSI, HOST_HL);
+            emitRead(offset);
+            emitMove(RCX, RAX);
+        }
+        else
+        {
+            emitLoadRegister(guest, RCX);
+        }
+        emitExtended(0xFE, decrement ? 1 : 0, RCX, true);
+        emitArithmeticFlags(0xA0, decrement ? 0x40 : 0x00, 0x1F);
+        if (guest == GUEST_MEMORY)
+        {
+            emitZeroExtend8(RDX, RCX);
+            emitMove(RSI, HOST_HL);
+            emitWrite(offset);
+            emitExitCheck(next, executed, offset, cycles);
+        }
+        else
+        {
+            emitStoreRegister(guest, RCX);
+        }
+        return true;
+    }
+
+    switch (operation)
+    {
+        case 0x00:
+            return true;
+
+        case 0x01: case 0x11: case 0x21: case 0x31:
+            emitMoveImmediate(pairHost(operation >> 4), operant);
+            return true;
+
+        case 0x03: case 0x13: case 0x23: case 0x33:
+        case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+            emitIncrementPair(pairHost(operation >> 4), operation & 0x08);
+            return true;
+
+        case 0x09: case 0x19: case 0x29: case 0x39:
+        {
+            uint8_t source = pairHost(operation >> 4);
+            //eax = HL + rr, bit 12 of HL ^ rr ^ eax is H and bit 16 of eax is C
+            emitMove(RAX, HOST_HL);
+            emitRegister(0x01, source, RAX);
+            emitMove(RCX, HOST_HL);
+            emitRegister(0x31, source, RCX);
+            emitRegister(0x31, RAX, RCX);
+            emitShift(5, RCX, 7);
+            emitImmediate(4, RCX, 0x20);
+            emitMove(RDX, RAX);
+            emitShift(5, RDX, 12);
+            emitImmediate(4, RDX, 0x10);
+            emitRegister(0x09, RDX, RCX);
+            emitImmediate(4, HOST_F, 0x8F);
+            emitRegister(0x09, RCX, HOST_F);
+            emitZeroExtend16(HOST_HL, RAX);
+            return true;
+        }
+
+        //LD (BC),A, LD (DE),A, LD A,(BC) and LD A,(DE)
+        case 0x02: case 0x12:
+            emitLoadRegister(GUEST_A, RDX);
+            emitMove(RSI, operation == 0x02 ? HOST_BC : HOST_DE);
+            emitWrite(offset);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+
+        case 0x0A: case 0x1A:
+            emitMove(RSI, operation == 0x0A ? HOST_BC : HOST_DE);
+            emitRead(offset);
+            emitStoreRegister(GUEST_A, RAX);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+
+        //LD (HL+),A, LD (HL-),A, LD A,(HL+) and LD A,(HL-)
+        case 0x22: case 0x32:
+            emitLoadRegister(GUEST_A, RDX);
+            emitMove(RSI, HOST_HL);
+            emitWrite(offset);
+            emitIncrementPair(HOST_HL, operation == 0x32);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+
+        case 0x2A: case 0x3A:
+            emitMove(RSI, HOST_HL);
+            emitRead(offset);
+            emitStoreRegister(GUEST_A, RAX);
+            emitIncrementPair(HOST_HL, operation == 0x3A);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+
+        //RLCA, RRCA, RLA and RRA
+        case 0x07: case 0x0F: case 0x17: case 0x1F:
+            if (operation >= 0x17) emit({ 0x0F, 0xBA, 0xE3, 0x04 });
+            emitShift(operation >> 3, HOST_A, 1, true);
+            emitRotateFlags(HOST_A, false, true);
+            return true;
+
+        //CPL, SCF and CCF
+        case 0x2F:
+            emitImmediate(6, HOST_A, 0xFF);
+            emitImmediate(1, HOST_F, 0x60);
+            return true;
+
+        case 0x37:
+            emitImmediate(4, HOST_F, 0x8F);
+            emitImmediate(1, HOST_F, 0x10);
+            return true;
+
+        case 0x3F:
+            emitImmediate(4, HOST_F, 0x9F);
+            emitImmediate(6, HOST_F, 0x10);
+            return true;
+
+        case 0x18:
+            emitExit(next + (int8_t)operant, executed, offset, cycles, next);
+            return true;
+
+        case 0x20: case 0x28: case 0x30: case 0x38:
+        {
+            size_t skip = emitSkipUnless();
+            emitExit(next + (int8_t)operant, executed, offset, cycles, next);
+            patchJump(skip);
+            return true;
+        }
+
+        case 0xC3:
+            emitExit(operant, executed, offset, cycles, next);
+            return true;
+
+        case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+        {
+            size_t skip = emitSkipUnless();
+            emitExit(operant, executed, offset, cycles, next);
+            patchJump(skip);
+            return true;
+        }
+
+        case 0xE9:
+            emitMove(RSI, HOST_HL);
+            emitExit(0, executed, offset, cycles, next, true);
+            return true;
+
+        case 0xCD:
+            emitPushImmediate(next, offset);
+            emitExit(operant, executed, offset, cycles, next);
+            return true;
+
+        case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+        {
+            size_t skip = emitSkipUnless();
+            emitPushImmediate(next, offset);
+            emitExit(operant, executed, offset, cycles, next);
+            patchJump(skip);
+            return true;
+        }
+
+        case 0xC9:
+            emitReturn();
+            return true;
+
+        case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+        {
+            size_t skip = emitSkipUnless();
+            emitReturn();
+            patchJump(skip);
+            return true;
+        }
+
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+            emitPushImmediate(next, offset);
+            emitExit(operation & 0x38, executed, offset, cycles, next);
+            return true;
+
+        //POP BC, DE, HL and AF, the low byte is read first
+        case 0xC1: case 0xD1: case 0xE1: case 0xF1:
+        {
+            uint8_t pair = (operation >> 4) & 3;
+            static const uint8_t lowRegisters[4] = { GUEST_C, GUEST_E, GUEST_L, GUEST_F };
+            static const uint8_t highRegisters[4] = { GUEST_B, GUEST_D, GUEST_H, GUEST_A };
+            emitPop();
+            emitStoreRegister(lowRegisters[pair], RAX);
+            emitPop();
+            emitStoreRegister(highRegisters[pair], RAX);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+        }
+
+        //PUSH BC, DE, HL and AF, the high byte is written first
+        case 0xC5: case 0xD5: case 0xE5: case 0xF5:
+        {
+            uint8_t pair = (operation >> 4) & 3;
+            static const uint8_t lowRegisters[4] = { GUEST_C, GUEST_E, GUEST_L, GUEST_F };
+            static const uint8_t highRegisters[4] = { GUEST_B, GUEST_D, GUEST_H, GUEST_A };
+            for (uint8_t guest : { highRegisters[pair], lowRegisters[pair] })
+            {
+                emitIncrementPair(HOST_SP, true);
+                emitLoadRegister(guest, RDX);
+                emitMove(RSI, HOST_SP);
+                emitWrite(offset);
+            }
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+        }
+
+        //LDH (n),A, LD (C),A and LD (nn),A
+        case 0xE0: case 0xE2: case 0xEA:
+            if (operation == 0xE2)
+            {
+                emitZeroExtend8(RSI, HOST_BC);
+                emitImmediate(1, RSI, 0xFF00);
+            }
+            else
+            {
+                emitMoveImmediate(RSI, operation == 0xE0 ? 0xFF00 + (operant & 0xFF) : operant);
+            }
+            emitLoadRegister(GUEST_A, RDX);
+            emitWrite(offset);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+
+        //LDH A,(n), LD A,(C) and LD A,(nn)
+        case 0xF0: case 0xF2: case 0xFA:
+            if (operation == 0xF2)
+            {
+                emitZeroExtend8(RSI, HOST_BC);
+                emitImmediate(1, RSI, 0xFF00);
+            }
+            else
+            {
+                emitMoveImmediate(RSI, operation == 0xF0 ? 0xFF00 + (operant & 0xFF) : operant);
+            }
+            emitRead(offset);
+            emitStoreRegister(GUEST_A, RAX);
+            emitExitCheck(next, executed, offset, cycles);
+            return true;
+
+        case 0xF9:
+            emitMove(HOST_SP, HOST_HL);
+            return true;
+    }
+
+    //DAA, the stack pointer arithmetic, HALT, STOP, DI, EI and RETI
+    return false;
+}
+
+void JitCompiler::emitExit(uint16_t programCounter, uint8_t executed, uint32_t offset, uint8_t cycles, uint16_t next, bool dynamicProgramCounter)
+{
+    if (!dynamicProgramCounter) emitMoveImmediate(RSI, programCounter);
+    emitMoveImmediate64(RDX, cycles | (uint64_t)executed << 8 | (uint64_t)offset << 16 | (uint64_t)next << 32);
+    //jmp to the shared exit
+    emit({ 0xE9 });
+    emit32((uint32_t)(m_exit - (m_cache + m_used + 4)));
+}
+
+void JitCompiler::emitExitCheck(uint16_t next, uint8_t executed, uint32_t offset, uint8_t cycles)
+{
+    //cmp byte [exit], 0
+    emitMoveImmediate64(RAX, (uint64_t)m_target.exit);
+    emit({ 0x80, 0x38, 0x00 });
+    size_t skip = emitJump(CONDITION_ZERO);
+    emitExit(next, executed, offset, cycles, next);
+    patchJump(skip);
+}
+
+void JitCompiler::emitLoadRegister(uint8_t guest, uint8_t host)
+{
+    switch (guest)
+    {
+        case GUEST_A: emitZeroExtend8(host, HOST_A); break;
+        case GUEST_F: emitZeroExtend8(host, HOST_F); break;
+        default:
+        {
+            uint8_t pair = pairHost(guest >> 1);
+            if (guest & 1)
+            {
+                emitZeroExtend8(host, pair);
+            }
+            else
+            {
+                emitMove(host, pair);
+                emitShift(5, host, 8);
+            }
+        }
+    }
+}
+
+void JitCompiler::emitStoreRegister(uint8_t guest, uint8_t host)
+{
+    switch (guest)
+    {
+        case GUEST_A: emitZeroExtend8(HOST_A, host); break;
+        //POP AF drops the lower nibble
+        case GUEST_F:
+            emitZeroExtend8(HOST_F, host);
+            emitImmediate(4, HOST_F, 0xF0);
+            break;
+        default:
+        {
+            uint8_t pair = pairHost(guest >> 1);
+            if (guest & 1)
+            {
+                emitRegister(0x88, host, pair, true);
+            }
+            else
+            {
+                emitZeroExtend8(host, host);
+                emitShift(4, host, 8);
+                emitImmediate(4, pair, 0xFF);
+                emitRegister(0x09, host, pair);
+            }
+        }
+    }
+}
+
+void JitCompiler::emitRead(uint32_t offset)
+{
+    //Address in esi, the byte is returned in eax
+    emitMoveImmediate(RDX, offset);
+    emitCallHandler((const void*)m_target.read);
+    emitZeroExtend8(RAX, RAX);
+}
+
+void JitCompiler::emitWrite(uint32_t offset)
+{
+    //Address in esi, value in edx
+    emitMoveImmediate(RCX, offset);
+    emitCallHandler((const void*)m_target.write);
+}
+
+void JitCompiler::emitPushImmediate(uint16_t value, uint32_t offset)
+{
+    for (uint8_t byte : { (uint8_t)(value >> 8), (uint8_t)value })
+    {
+        emitImmediate(5, HOST_SP, 1);
+        emitZeroExtend16(HOST_SP, HOST_SP);
+        emitMoveImmediate(RDX, byte);
+        emitMove(RSI, HOST_SP);
+        emitWrite(offset);
+    }
+}
+
+void JitCompiler::emitArithmeticFlags(uint8_t mask, uint8_t set, uint8_t keep)
+{
+    //lahf; movzx eax, ah; movzx eax, byte [FLAG_TABLE + rax]
+    emit({ 0x9F, 0x0F, 0xB6, 0xC4 });
+    emitMoveImmediate64(RDX, (uint64_t)FLAG_TABLE.data());
+    emit({ 0x0F, 0xB6, 0x04, 0x02 });
+
+    if (mask != 0xB0) emitImmediate(4, RAX, mask);
+    if (set) emitImmediate(1, RAX, set);
+    emitImmediate(4, HOST_F, keep);
+    emitRegister(0x09, RAX, HOST_F);
+}
+
+void JitCompiler::emitRotateFlags(uint8_t valueHost, bool zero, bool carry)
+{
+    if (carry)
+    {
+        //setc al
+        emit({ 0x0F, 0x92, 0xC0 });
+        emitZeroExtend8(RAX, RAX);
+        emitShift(4, RAX, 4);
+    }
+    else
+    {
+        emitRegister(0x31, RAX, RAX);
+    }
+
+    if (zero)
+    {
+        //test value, value; setz dl
+        emitRegister(0x84, valueHost, valueHost, true);
+        emit({ 0x0F, 0x94, 0xC2 });
+        emitZeroExtend8(RDX, RDX);
+        emitShift(4, RDX, 7);
+        emitRegister(0x09, RDX, RAX);
+    }
+
+    //N and H are cleared
+    emitImmediate(4, HOST_F, 0x0F);
+    emitRegister(0x09, RAX, HOST_F);
+}
+
+void JitCompiler::emitCallHandler(const void* handler)
+{
+    emitMoveImmediate64(RDI, (uint64_t)m_target.context);
+    emitMoveImmediate64(RAX, (uint64_t)handler);
+    //call rax
+    emit({ 0xFF, 0xD0 });
+}
+
+void JitCompiler::emit(std::initializer_list<uint8_t> bytes)
+{
+    for (uint8_t byte : bytes) m_cache[m_used++] = byte;
+}
+
+void JitCompiler::emit32(uint32_t value)
+{
+    memcpy(m_cache + m_used, &value, sizeof(value));
+    m_used += sizeof(value);
+}
+
+void JitCompiler::emit64(uint64_t value)
+{
+    memcpy(m_cache + m_used, &value, sizeof(value));
+    m_used += sizeof(value);
+}
+
+void JitCompiler::emitRex(bool wide, uint8_t reg, uint8_t rm, bool byteRegisters)
+{
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | (reg & 8 ? 0x04 : 0) | (rm & 8 ? 0x01 : 0);
+    //Without a REX prefix the byte registers 4 to 7 would be AH, CH, DH and BH
+    bool needed = byteRegisters && ((reg >= 4 && reg < 8) || (rm >= 4 && rm < 8));
+    if (rex != 0x40 || needed) emit({ rex });
+}
+
+void JitCompiler::emitRegister(uint8_t opCode, uint8_t reg, uint8_t rm, bool byteRegisters)
+{
+    emitRex(false, reg, rm, byteRegisters);
+    emit({ opCode, (uint8_t)(0xC0 | (reg & 7) << 3 | (rm & 7)) });
+}
+
+void JitCompiler::emitExtended(uint8_t opCode, uint8_t extension, uint8_t rm, bool byteRegisters)
+{
+    emitRex(false, 0, rm, byteRegisters);
+    emit({ opCode, (uint8_t)(0xC0 | extension << 3 | (rm & 7)) });
+}
+
+void JitCompiler::emitImmediate(uint8_t extension, uint8_t rm, uint32_t value)
+{
+    if ((int32_t)value >= -128 && (int32_t)value <= 127)
+    {
+        emitExtended(0x83, extension, rm);
+        emit({ (uint8_t)value });
+    }
+    else
+    {
+        emitExtended(0x81, extension, rm);
+        emit32(value);
+    }
+}
+
+void JitCompiler::emitShift(uint8_t extension, uint8_t rm, uint8_t count, bool byteRegister)
+{
+    uint8_t opCode = byteRegister ? 0xC0 : 0xC1;
+    if (count == 1) opCode += 0x10;
+    emitExtended(opCode, extension, rm, byteRegister);
+    if (count != 1) emit({ count });
+}
+
+void JitCompiler::emitMove(uint8_t destination, uint8_t source)
+{
+    emitRegister(0x89, source, destination);
+}
+
+void JitCompiler::emitMoveImmediate(uint8_t destination, uint32_t value)
+{
+    emitRex(false, 0, destination);
+    emit({ (uint8_t)(0xB8 + (destination & 7)) });
+    emit32(value);
+}
+
+void JitCompiler::emitMoveImmediate64(uint8_t destination, uint64_t value)
+{
+    emit({ (uint8_t)(0x48 | (destination & 8 ? 0x01 : 0)), (uint8_t)(0xB8 + (destination & 7)) });
+    emit64(value);
+}
+
+void JitCompiler::emitZeroExtend8(uint8_t destination, uint8_t source)
+{
+    emitRex(false, destination, source, true);
+    emit({ 0x0F, 0xB6, (uint8_t)(0xC0 | (destination & 7) << 3 | (source & 7)) });
+}
+
+void JitCompiler::emitZeroExtend16(uint8_t destination, uint8_t source)
+{
+    emitRex(false, destination, source);
+    emit({ 0x0F, 0xB7, (uint8_t)(0xC0 | (destination & 7) << 3 | (source & 7)) });
+}
+
+size_t JitCompiler::emitJump(uint8_t condition)
+{
+    if (condition == CONDITION_ALWAYS)
+        emit({ 0xE9 });
+    else
+        emit({ 0x0F, (uint8_t)(0x80 | condition) });
+
+    size_t at = m_used;
+    emit32(0);
+    return at;
+}
+
+void JitCompiler::patchJump(size_t at)
+{
+    uint32_t distance = (uint32_t)(m_used - (at + 4));
+    memcpy(m_cache + at, &distance, sizeof(distance));
+}
@@ -0,0 +1,181 @@
+#include "../include/Peripheral/lineCompositor.hpp"
+
+#if defined(__SSE2__)
+    #define GBEMU_HAS_SSE2
+    #include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define GBEMU_HAS_SSSE3
+    #define GBEMU_HAS_AVX2
+    #include <immintrin.h>
+#endif
+
+static_assert(LINE_WIDTH % 32 == 0, "The vector paths process whole blocks of pixels");
+
+void LineCompositor::composeScalar(const uint8_t* background, const uint8_t* objects, const LinePalettes& palettes, uint8_t* shades)
+{
+    for (int x = 0; x < LINE_WIDTH; x++)
+    {
+        uint8_t shade = palettes.shades[background[x]];
+        uint8_t object = objects[x];
+
+        //Objects behind the background only show through background color 0
+        if ((object & OBJECT_COLOR_MASK) && (!(object & OBJECT_BEHIND_BG) || background[x] == 0))
+        {
+            shade = palettes.shades[4 + (object & (OBJECT_COLOR_MASK | OBJECT_PALETTE_1))];
+        }
+
+        shades[x] = shade;
+    }
+}
+
+#ifdef GBEMU_HAS_SSE2
+//Mask of the lanes whose byte has the bit set
+static inline __m128i bitMask(__m128i bytes, uint8_t bit)
+{
+    __m128i mask = _mm_set1_epi8(bit);
+    return _mm_cmpeq_epi8(_mm_and_si128(bytes, mask), mask);
+}
+
+//a where the mask is set, b elsewhere, with differenceAB = a ^ b
+static inline __m128i select(__m128i mask, __m128i differenceAB, __m128i b)
+{
+    return _mm_xor_si128(b, _mm_and_si128(mask, differenceAB));
+}
+
+//SSE2 has no byte shuffle, so the palettes are applied as a tree of selects on the color bits
+static void composeSSE2(const uint8_t* background, const uint8_t* objects, const LinePalettes& palettes, uint8_t* shades)
+{
+    const uint8_t* shade = palettes.shades;
+
+    const __m128i background0 = _mm_set1_epi8(shade[0]);
+    const __m128i background10 = _mm_set1_epi8(shade[1] ^ shade[0]);
+    const __m128i background2 = _mm_set1_epi8(shade[2]);
+    const __m128i background32 = _mm_set1_epi8(shade[3] ^ shade[2]);
+
+    //Color 0 of the objects is transparent, only colors 1-3 of both palettes are looked up
+    const __m128i object1 = _mm_set1_epi8(shade[5]);
+    const __m128i object1Palette = _mm_set1_epi8(shade[9] ^ shade[5]);
+    const __m128i object2 = _mm_set1_epi8(shade[6]);
+    const __m128i object2Palette = _mm_set1_epi8(shade[10] ^ shade[6]);
+    const __m128i object3 = _mm_set1_epi8(shade[7]);
+    const __m128i object3Palette = _mm_set1_epi8(shade[11] ^ shade[7]);
+
+    for (int x = 0; x < LINE_WIDTH; x += 16)
+    {
+        __m128i backgroundColors = _mm_loadu_si128((const __m128i*)(background + x));
+        __m128i objectPixels = _mm_loadu_si128((const __m128i*)(objects + x));
+
+        __m128i backgroundBit0 = bitMask(backgroundColors, 1);
+        __m128i backgroundBit1 = bitMask(backgroundColors, 2);
+        __m128i low = select(backgroundBit0, background10, background0);
+        __m128i high = select(backgroundBit0, background32, background2);
+        __m128i backgroundShades = select(backgroundBit1, _mm_xor_si128(high, low), low);
+
+        __m128i objectBit0 = bitMask(objectPixels, 1);
+        __m128i objectBit1 = bitMask(objectPixels, 2);
+        __m128i palette1 = bitMask(objectPixels, OBJECT_PALETTE_1);
+        __m128i shade1 = select(palette1, object1Palette, object1);
+        __m128i shade2 = select(palette1, object2Palette, object2);
+        __m128i shade3 = select(palette1, object3Palette, object3);
+        __m128i shade23 = select(objectBit0, _mm_xor_si128(shade3, shade2), shade2);
+        __m128i objectShades = select(objectBit1, _mm_xor_si128(shade23, shade1), shade1);
+
+        //Objects behind the background only show through background color 0
+        __m128i opaque = _mm_or_si128(objectBit0, objectBit1);
+        __m128i covered = _mm_and_si128(bitMask(objectPixels, OBJECT_BEHIND_BG), _mm_or_si128(backgroundBit0, backgroundBit1));
+        __m128i visible = _mm_andnot_si128(covered, opaque);
+
+        __m128i result = select(visible, _mm_xor_si128(objectShades, backgroundShades), backgroundShades);
+        _mm_storeu_si128((__m128i*)(shades + x), result);
+    }
+}
+#endif
+
+#ifdef GBEMU_HAS_SSSE3
+//The AVX2 path on 16 pixels, SSSE3 has the byte shuffle but no blend
+__attribute__((target("ssse3")))
+static void composeSSSE3(const uint8_t* background, const uint8_t* objects, const LinePalettes& palettes, uint8_t* shades)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorMask = _mm_set1_epi8(OBJECT_COLOR_MASK);
+    const __m128i objectKeyMask = _mm_set1_epi8(OBJECT_COLOR_MASK | OBJECT_PALETTE_1);
+    const __m128i behindMask = _mm_set1_epi8(OBJECT_BEHIND_BG);
+    const __m128i objectOffset = _mm_set1_epi8(4);
+    const __m128i palette = _mm_loadu_si128((const __m128i*)palettes.shades);
+
+    for (int x = 0; x < LINE_WIDTH; x += 16)
+    {
+        __m128i backgroundColors = _mm_loadu_si128((const __m128i*)(background + x));
+        __m128i objectPixels = _mm_loadu_si128((const __m128i*)(objects + x));
+
+        __m128i backgroundShades = _mm_shuffle_epi8(palette, backgroundColors);
+        __m128i objectKeys = _mm_add_epi8(_mm_and_si128(objectPixels, objectKeyMask), objectOffset);
+        __m128i objectShades = _mm_shuffle_epi8(palette, objectKeys);
+
+        __m128i transparent = _mm_cmpeq_epi8(_mm_and_si128(objectPixels, colorMask), zero);
+        __m128i behind = _mm_cmpeq_epi8(_mm_and_si128(objectPixels, behindMask), behindMask);
+        __m128i hidden = _mm_or_si128(transparent, _mm_andnot_si128(_mm_cmpeq_epi8(backgroundColors, zero), behind));
+
+        __m128i result = _mm_or_si128(_mm_and_si128(hidden, backgroundShades), _mm_andnot_si128(hidden, objectShades));
+        _mm_storeu_si128((__m128i*)(shades + x), result);
+    }
+}
+#endif
+
+#ifdef GBEMU_HAS_AVX2
+__attribute__((target("avx2")))
+static void composeAVX2(const uint8_t* background, const uint8_t* objects, const LinePalettes& palettes, uint8_t* shades)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set1_epi8(OBJECT_COLOR_MASK);
+    const __m256i objectKeyMask = _mm256_set1_epi8(OBJECT_COLOR_MASK | OBJECT_PALETTE_1);
+    const __m256i behindMask = _mm256_set1_epi8(OBJECT_BEHIND_BG);
+    const __m256i objectOffset = _mm256_set1_epi8(4);
+    const __m256i palette = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)palettes.shades));
+
+    for (int x = 0; x < LINE_WIDTH; x += 32)
+    {
+        __m256i backgroundColors = _mm256_loadu_si256((const __m256i*)(background + x));
+        __m256i objectPixels = _mm256_loadu_si256((const __m256i*)(objects + x));
+
+        __m256i backgroundShades = _mm256_shuffle_epi8(palette, backgroundColors);
+        __m256i objectKeys = _mm256_add_epi8(_mm256_and_si256(objectPixels, objectKeyMask), objectOffset);
+        __m256i objectShades = _mm256_shuffle_epi8(palette, objectKeys);
+
+        __m256i transparent = _mm256_cmpeq_epi8(_mm256_and_si256(objectPixels, colorMask), zero);
+        __m256i behind = _mm256_cmpeq_epi8(_mm256_and_si256(objectPixels, behindMask), behindMask);
+        __m256i hidden = _mm256_or_si256(transparent, _mm256_andnot_si256(_mm256_cmpeq_epi8(backgroundColors, zero), behind));
+
+        __m256i result = _mm256_blendv_epi8(objectShades, backgroundShades, hidden);
+        _mm256_storeu_si256((__m256i*)(shades + x), result);
+    }
+}
+#endif
+
+std::vector<LineCompositor::Implementation> LineCompositor::implementations()
+{
+    std::vector<Implementation> supported;
+#ifdef GBEMU_HAS_AVX2
+    if (__builtin_cpu_supports("avx2")) supported.push_back({ "AVX2", composeAVX2 });
+#endif
+#ifdef GBEMU_HAS_SSSE3
+    if (__builtin_cpu_supports("ssse3")) supported.push_back({ "SSSE3", composeSSSE3 });
+#endif
+#ifdef GBEMU_HAS_SSE2
+    supported.push_back({ "SSE2", composeSSE2 });
+#endif
+    supported.push_back({ "scalar", composeScalar });
+    return supported;
+}
+
+LineCompositor::ComposeFunction LineCompositor::selectImplementation()
+{
+    return implementations().front().compose;
+}
+
+const char* LineCompositor::implementationName()
+{
+    return implementations().front().name;
+}
@@ -0,0 +1,176 @@
+#include "../include/movie.hpp"
+
+#include <cstring>
+#include <fstream>
+
+//FNV-1a, only has to tell two runs of the same build apart
+static uint64_t hashBytes(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+void Movie::romIdentity(GameBoy& gameBoy, MovieHeader& header)
+{
+    for (uint16_t i = 0; i < sizeof(header.title); i++)
+    {
+        header.title[i] = gameBoy.memoryBus().readMemoryBus(0x134 + i);
+    }
+    header.globalChecksum = (gameBoy.memoryBus().readMemoryBus(0x14E) << 8) | gameBoy.memoryBus().readMemoryBus(0x14F);
+}
+
+void Movie::record(GameBoy& gameBoy, uint32_t checksumInterval)
+{
+    stop();
+
+    m_header = {};
+    memcpy(m_header.magic, MOVIE_MAGIC, sizeof(m_header.magic));
+    m_header.formatVersion = MOVIE_FORMAT_VERSION;
+    m_header.checksumInterval = checksumInterval;
+    romIdentity(gameBoy, m_header);
+
+    m_snapshot.clear();
+    if (gameBoy.cycles() == 0 && gameBoy.frameCount() == 0)
+    {
+        m_header.start = MovieStart::POWER_ON;
+    }
+    else
+    {
+        m_header.start = MovieStart::SNAPSHOT;
+        gameBoy.snapshot(m_snapshot);
+    }
+
+    //An hour of frames, so recording does not allocate in the frame loop
+    m_inputs.clear();
+    m_inputs.reserve(60 * 60 * 60);
+    m_checksums.clear();
+    m_frame = 0;
+    m_divergentFrame = NO_DIVERGENCE;
+
+    m_gameBoy = &gameBoy;
+    gameBoy.setFrameStartHandler([this]() { recordFrame(); });
+}
+
+bool Movie::play(GameBoy& gameBoy)
+{
+    stop();
+
+    MovieHeader identity = {};
+    romIdentity(gameBoy, identity);
+    if (memcmp(m_header.title, identity.title, sizeof(identity.title)) != 0 || m_header.globalChecksum != identity.globalChecksum) return false;
+
+    if (m_header.start == MovieStart::POWER_ON)
+    {
+        if (gameBoy.cycles() != 0 || gameBoy.frameCount() != 0) return false;
+    }
+    else if (!gameBoy.restore(m_snapshot))
+    {
+        return false;
+    }
+
+    m_frame = 0;
+    m_divergentFrame = NO_DIVERGENCE;
+
+    m_gameBoy = &gameBoy;
+    gameBoy.setFrameStartHandler([this]() { playFrame(); });
+    return true;
+}
+
+void Movie::stop()
+{
+    if (m_gameBoy) m_gameBoy->setFrameStartHandler(nullptr);
+    m_gameBoy = nullptr;
+}
+
+uint64_t Movie::checksum()
+{
+    m_gameBoy->snapshot(m_state);
+    return hashBytes(m_state.data(), m_state.size());
+}
+
+void Movie::recordFrame()
+{
+    m_inputs.push_back(m_gameBoy->controller().state());
+
+    if (m_header.checksumInterval && m_frame % m_header.checksumInterval == 0)
+    {
+        m_checksums.push_back(checksum());
+    }
+    m_frame++;
+}
+
+void Movie::playFrame()
+{
+    //After the last frame the input stays as it is
+    if (m_frame >= m_inputs.size()) return;
+
+    m_gameBoy->controller().setState(m_inputs[m_frame]);
+
+    if (m_header.checksumInterval && m_frame % m_header.checksumInterval == 0 && m_divergentFrame == NO_DIVERGENCE)
+    {
+        uint64_t index = m_frame / m_header.checksumInterval;
+        if (index < m_checksums.size() && m_checksums[index] != checksum()) m_divergentFrame = m_frame;
+    }
+    m_frame++;
+}
+
+bool Movie::write(const char* fileName) const
+{
+    MovieHeader header = m_header;
+    header.snapshotSize = m_snapshot.size();
+    header.frameCount = m_inputs.size();
+    header.checksumCount = m_checksums.size();
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)m_snapshot.data(), m_snapshot.size());
+    file.write((const char*)m_inputs.data(), m_inputs.size());
+    file.write((const char*)m_checksums.data(), m_checksums.size() * sizeof(uint64_t));
+
+    return file.good();
+}
+
+bool Movie::read(const char* fileName)
+{
+    stop();
+
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+
+    uint64_t size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    MovieHeader header;
+    if (size < sizeof(header) || !file.read((char*)&header, sizeof(header))) return false;
+
+    if (memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) != 0) return false;
+    if (header.formatVersion > MOVIE_FORMAT_VERSION) return false;
+
+    //Checked one by one, so the sum cannot overflow
+    uint64_t remaining = size - sizeof(header);
+    if (header.snapshotSize > remaining) return false;
+    remaining -= header.snapshotSize;
+    if (header.frameCount > remaining) return false;
+    remaining -= header.frameCount;
+    if (header.checksumCount != remaining / sizeof(uint64_t)) return false;
+
+    m_snapshot.resize(header.snapshotSize);
+    m_inputs.resize(header.frameCount);
+    m_checksums.resize(header.checksumCount);
+
+    file.read((char*)m_snapshot.data(), m_snapshot.size());
+    file.read((char*)m_inputs.data(), m_inputs.size());
+    file.read((char*)m_checksums.data(), m_checksums.size() * sizeof(uint64_t));
+    if (!file) return false;
+
+    m_header = header;
+    m_frame = 0;
+    m_divergentFrame = NO_DIVERGENCE;
+    return true;
+}
@@ -1,7 +1,11 @@
 #include "../include/Peripheral/ppu.hpp"
+#include "../include/Peripheral/lineCompositor.hpp"
 
-PictureProcessingUnit::PictureProcessingUnit(InterruptController& interruptController, LcdcStatus& lcdcStatus) : 
-    m_lcdcStatus(lcdcStatus), InterruptSource(interruptController, InterruptFlags::V_BLANK_FLAG)
+#include <cstring>
+
+
+PictureProcessingUnit::PictureProcessingUnit(InterruptController& interruptController, LcdcStatus& lcdcStatus, Scheduler& scheduler) : 
+    m_lcdcStatus(lcdcStatus), m_scheduler(scheduler), InterruptSource(interruptController, InterruptFlags::V_BLANK_FLAG)
 {
     m_peripheralMemoryMap.insert(m_oam.toPair());
     m_peripheralMemoryMap.insert(m_vram.toPair());
@@ -18,6 +22,59 @@ PictureProcessingUnit::PictureProcessingUnit(InterruptController& interruptContr
 
     m_peripheralMemoryMap.insert(m_objectPalette0.toPair());
     m_peripheralMemoryMap.insert(m_objectPalette1.toPair());
+
+    m_dirtyTiles.fill(~0ull);
+
+    //Only tile data is cached, the tile maps are read directly
+    m_vram.setOnWriteHandler([&](const uint16_t address, uint8_t& value)
+    {
+        uint16_t offset = address - VRAM_ADDRESS;
+        if (offset >= TILE_DATA_SIZE) return;
+
+        uint16_t tile = offset / TILE_SIZE;
+        m_dirtyTiles[tile / 64] |= 1ull << (tile % 64);
+        m_hasDirtyTiles = true;
+    });
+
+    m_scheduler.get().setEventHandler(SchedulerEvent::PPU_MODE, [&](uint64_t timestamp)
+    {
+        modeTransition(timestamp);
+    });
+
+    m_scheduler.get().setEventHandler(SchedulerEvent::PPU_DRAW, [&](uint64_t timestamp)
+    {
+        uint32_t position = timestamp - m_frameStart;
+        drawLine(position / CYCLES_PER_LINE);
+        scheduleDraw(position);
+    });
+
+    //Nothing changes, the dispatch alone ends the skipping of a loop that polls LY, STAT or VRAM
+    m_scheduler.get().setEventHandler(SchedulerEvent::PPU_READ, [](uint64_t timestamp) { });
+
+    //LY and STAT are derived from the frame start when they are read
+    m_yLine.setOnReadHandler([&](const uint16_t& address)
+    {
+        m_yLine.value() = currentLine();
+        if (m_lcdcStatus.get().ppuEnabled()) scheduleReadChange((m_yLine.value() + 1) * CYCLES_PER_LINE);
+    });
+
+    m_lcdcStatus.get().registerStatusHandlers([&](const uint16_t& address)
+    {
+        m_lcdcStatus.get().updateStatus(currentMode(), currentLine());
+        if (m_lcdcStatus.get().ppuEnabled()) scheduleReadChange(nextModeChange(framePosition()));
+    },
+    [&]()
+    {
+        //Other interrupt sources need events at other transitions
+        if (m_lcdcStatus.get().ppuEnabled()) scheduleTransition(framePosition());
+    });
+
+    m_lcdcStatus.get().registerControlHandler([&](const uint16_t address, uint8_t& value)
+    {
+        bool enable = value & PPU_ENABLE_FLAG;
+        if (enable != m_lcdcStatus.get().ppuEnabled())
+            switchDisplay(enable);
+    });
 }
 
 void PictureProcessingUnit::registerDmaHandler(MemoryWriteHandler handler)
@@ -25,11 +82,101 @@ void PictureProcessingUnit::registerDmaHandler(MemoryWriteHandler handler)
     m_omaDma.setOnWriteHandler(handler);
 }
 
+void PictureProcessingUnit::convertFrame(PixelFormat format, void* destination)
+{
+    FrameConverter::convert(frameBuffer[0], V_RES * H_RES, format, destination);
+}
+
+void PictureProcessingUnit::setRenderPolicy(RenderPolicy policy, unsigned interval)
+{
+    m_renderPolicy = policy;
+    m_renderInterval = interval ? interval : 1;
+    m_framesSinceRender = 0;
+}
+
+void PictureProcessingUnit::setRenderState(const RenderState& state)
+{
+    m_renderPolicy = state.policy;
+    m_renderInterval = state.interval;
+    m_framesSinceRender = state.framesSinceRender;
+    m_frameRequested = state.frameRequested;
+    m_renderFrame = state.renderFrame;
+
+    if (m_lcdcStatus.get().ppuEnabled()) scheduleDraw(framePosition());
+}
+
+void PictureProcessingUnit::beginFrame()
+{
+    switch(m_renderPolicy)
+    {
+        case RenderPolicy::ALL:
+            m_renderFrame = true;
+            break;
+
+        case RenderPolicy::EVERY_NTH:
+            m_renderFrame = m_framesSinceRender == 0;
+            m_framesSinceRender = (m_framesSinceRender + 1) % m_renderInterval;
+            break;
+
+        case RenderPolicy::ON_DEMAND:
+            m_renderFrame = m_frameRequested;
+            m_frameRequested = false;
+            break;
+
+        case RenderPolicy::NEVER:
+            m_renderFrame = false;
+            break;
+    }
+}
+
+void PictureProcessingUnit::serialize(StateArchive& archive)
+{
+    Peripheral::serialize(archive);
+
+    if (archive.isLoading() && archive.version() == 0)
+    {
+        //The first layout stored the mode and the sprites of the line, the frame start follows
+        //from the stored LY and the deadline at which the mode ended
+        uint8_t spritesInLine;
+        std::array<Sprite, SPRITE_LIMIT> sprites;
+        PPUState mode;
+        archive.value(spritesInLine);
+        archive.value(sprites);
+        archive.value(mode);
+
+        uint32_t modeEnd = m_yLine.value() * CYCLES_PER_LINE;
+        switch(mode)
+        {
+            case PPUState::OAM_SEARCH_MODE_2: modeEnd += OAM_CYCLES; break;
+            case PPUState::LINE_RENDER_MODE_3: modeEnd += H_BLANK_START; break;
+            default: modeEnd += CYCLES_PER_LINE; break;
+        }
+        m_frameStart = m_scheduler.get().deadline(SchedulerEvent::PPU_MODE) - modeEnd;
+        if (m_lcdcStatus.get().ppuEnabled()) scheduleTransition(framePosition());
+    }
+    else
+    {
+        archive.value(m_frameStart);
+    }
+
+    if (archive.isLoading())
+    {
+        m_dirtyTiles.fill(~0ull);
+        m_hasDirtyTiles = true;
+
+        //Drawing is not part of the state, the scheduler dropped the event
+        if (m_lcdcStatus.get().ppuEnabled()) scheduleDraw(framePosition());
+    }
+}
+
 uint8_t PictureProcessingUnit::readFromPeripheral(uint16_t address)
 {   
     uint8_t memoryValue = 0;
 
-    switch(m_currentMode)
+    //Only OAM and VRAM come here, whether they can be read changes with the mode
+    if (m_lcdcStatus.get().ppuEnabled()) scheduleReadChange(nextModeChange(framePosition()));
+
+    switch(currentMode())
     {
         case PPUState::H_BLANK_MODE_0:
         case PPUState::V_BLANK_MODE_1:
@@ -63,7 +210,7 @@ uint8_t PictureProcessingUnit::readFromPeripheral(uint16_t address)
 
 void PictureProcessingUnit::writeToPeripheral(uint16_t address, uint8_t value)
 {
-    switch(m_currentMode)
+    switch(currentMode())
     {
         case PPUState::H_BLANK_MODE_0:
         case PPUState::V_BLANK_MODE_1:
@@ -85,265 +232,321 @@ void PictureProcessingUnit::writeToPeripheral(uint16_t address, uint8_t value)
     }
 }
 
+Memory* PictureProcessingUnit::memoryForAddress(uint16_t address)
+{
+    //VRAM and OAM access depends on the current mode, so those have to go through the PPU
+    auto memory = getMemoryForAddress(address);
+    if (memory.first == OAM_ADDRESS || memory.first == VRAM_ADDRESS)
+        return nullptr;
+
+    return memory.second;
+}
+
+PPUState PictureProcessingUnit::modeAt(uint32_t position)
+{
+    if (position >= V_RES * CYCLES_PER_LINE) return PPUState::V_BLANK_MODE_1;
+
+    uint32_t dot = position % CYCLES_PER_LINE;
+    if (dot < OAM_CYCLES) return PPUState::OAM_SEARCH_MODE_2;
+    if (dot < H_BLANK_START) return PPUState::LINE_RENDER_MODE_3;
+    return PPUState::H_BLANK_MODE_0;
+}
 
-void PictureProcessingUnit::tick(uint8_t cycles)
+uint32_t PictureProcessingUnit::nextModeChange(uint32_t position)
 {
+    uint32_t dot = position % CYCLES_PER_LINE;
+    uint32_t lineStart = position - dot;
 
-    if (!m_lcdcStatus.get().ppuEnabled())
+    if (position < V_RES * CYCLES_PER_LINE)
     {
-        m_currentMode = PPUState::H_BLANK_MODE_0;
-        m_currentCycle = 0;
-        m_yLine.value() = 0;
-        m_lcdcStatus.get().updateStatus(m_currentMode, m_yLine.value());
-        return;
+        if (dot < OAM_CYCLES) return lineStart + OAM_CYCLES;
+        if (dot < H_BLANK_START) return lineStart + H_BLANK_START;
     }
-    
-    m_lcdcStatus.get().updateStatus(m_currentMode, m_yLine.value());
+    return lineStart + CYCLES_PER_LINE;
+}
 
-    if (m_currentCycle == 0 && m_currentMode == PPUState::V_BLANK_MODE_1)
-        raiseInterrupt();
+PPUState PictureProcessingUnit::currentMode()
+{
+    return m_lcdcStatus.get().ppuEnabled() ? modeAt(framePosition()) : PPUState::H_BLANK_MODE_0;
+}
 
-    m_currentCycle += cycles;
+uint8_t PictureProcessingUnit::currentLine()
+{
+    return m_lcdcStatus.get().ppuEnabled() ? framePosition() / CYCLES_PER_LINE : 0;
+}
 
-    switch(m_currentMode)
+void PictureProcessingUnit::switchDisplay(bool enable)
+{
+    //Called before LCDC is written, ppuEnabled() still returns the previous state
+    if (enable)
     {
-        case PPUState::OAM_SEARCH_MODE_2:
+        m_frameStart = m_scheduler.get().now();
+        beginFrame();
+        m_lcdcStatus.get().enterMode(PPUState::OAM_SEARCH_MODE_2, 0);
+        scheduleTransition(0);
+        scheduleDraw(0);
+    }
+    else
+    {
+        //The display stops in H-Blank, only leaving another mode raises its interrupt
+        if (currentMode() != PPUState::H_BLANK_MODE_0)
+            m_lcdcStatus.get().enterMode(PPUState::H_BLANK_MODE_0, 0);
 
+        m_scheduler.get().cancel(SchedulerEvent::PPU_MODE);
+        m_scheduler.get().cancel(SchedulerEvent::PPU_DRAW);
+    }
+}
 
-            if (m_currentCycle >= OAM_CYCLES)
-            {
-                m_currentMode = PPUState::LINE_RENDER_MODE_3;
-                m_currentCycle = 0;
-                searchSprites(m_yLine.value());
-            }
-                
+void PictureProcessingUnit::modeTransition(uint64_t timestamp)
+{
+    //Positions are relative to the transition time, not to when the event got handled
+    uint32_t position = timestamp - m_frameStart;
 
-            break;
+    if (position == FRAME_CYCLES)
+    {
+        m_frameStart = timestamp;
+        position = 0;
+        beginFrame();
+        m_lcdcStatus.get().enterMode(PPUState::OAM_SEARCH_MODE_2, 0);
+        scheduleDraw(position);
+    }
+    else if (position == V_RES * CYCLES_PER_LINE)
+    {
+        raiseInterrupt();
+        if (m_renderFrame && m_frameCompleteHandler) m_frameCompleteHandler();
+        m_lcdcStatus.get().enterMode(PPUState::V_BLANK_MODE_1, V_RES);
+    }
+    else
+    {
+        m_lcdcStatus.get().enterMode(modeAt(position), position / CYCLES_PER_LINE);
+    }
 
-        case PPUState::LINE_RENDER_MODE_3:
+    scheduleTransition(position);
+}
 
-            if (m_currentCycle >= LINE_RENDER_CYCLES)
-            {
-                m_currentMode = PPUState::H_BLANK_MODE_0;
-                m_currentCycle = 0;
-                drawLine(m_yLine.value());
-                m_yLine.value()++;
-            }
-            break;
+void PictureProcessingUnit::scheduleTransition(uint32_t position)
+{
+    LcdcStatus& status = m_lcdcStatus;
 
-        case PPUState::H_BLANK_MODE_0:
+    //Only transitions that raise an interrupt need an event, V-Blank and the frame end always do.
+    //The lines in V-Blank do not change the mode and raise nothing.
+    uint32_t next = position < V_RES * CYCLES_PER_LINE ? V_RES * CYCLES_PER_LINE : FRAME_CYCLES;
+
+    if (status.interruptEnabled(MODE_OAM_IE | MODE_HBLANK_IE | MODE_LYC_IE))
+    {
+        bool oamInterrupt = status.interruptEnabled(MODE_OAM_IE);
+        bool hBlankInterrupt = status.interruptEnabled(MODE_HBLANK_IE);
+
+        for (uint32_t line = position / CYCLES_PER_LINE; line < V_RES; line++)
         {
-            auto nextMode = m_yLine.value() == V_RES - 1 ? PPUState::V_BLANK_MODE_1 : PPUState::OAM_SEARCH_MODE_2;
- 
-            if (m_currentCycle >= H_BLANK_CYCLES)
+            uint32_t lineStart = line * CYCLES_PER_LINE;
+            bool lineCompare = status.lineCompareInterrupt(line);
+
+            //Line 0 starts with the frame
+            if (lineStart > position && (oamInterrupt || lineCompare))
             {
-                m_currentCycle = 0;
-                m_currentMode = nextMode;
+                next = lineStart;
+                break;
             }
-
-            break;
-        }
-        case PPUState::V_BLANK_MODE_1:
-
-            if (m_currentCycle >= V_BLANK_CYCLES)
+            if (lineStart + OAM_CYCLES > position && lineCompare)
             {
-                m_currentCycle = 0;
-                m_yLine.value()++;
+                next = lineStart + OAM_CYCLES;
+                break;
             }
-
-            if (m_yLine.value() == V_BLANK_BOUND)
+            if (lineStart + H_BLANK_START > position && (hBlankInterrupt || lineCompare))
             {
-                m_currentMode = PPUState::OAM_SEARCH_MODE_2;
-                m_yLine.value() = 0;
+                next = lineStart + H_BLANK_START;
+                break;
             }
-                
-            break;
+        }
     }
+
+    m_scheduler.get().schedule(SchedulerEvent::PPU_MODE, m_frameStart + next);
 }
 
-void PictureProcessingUnit::drawLine(uint8_t line)
-{   
-    if (m_lcdcStatus.get().bgWindowPrioEnabled())     
-    {
-        drawBackground(line);
+void PictureProcessingUnit::scheduleDraw(uint32_t position)
+{
+    //Lines are drawn when they enter H-Blank, the first one after the position is next
+    uint32_t line = position < H_BLANK_START ? 0 : (position - H_BLANK_START) / CYCLES_PER_LINE + 1;
 
-        if (m_lcdcStatus.get().windowEnabled())
-            drawWindow(line);
-        
+    if (!m_renderFrame || line >= V_RES)
+    {
+        m_scheduler.get().cancel(SchedulerEvent::PPU_DRAW);
+        return;
     }
-
-    if (m_lcdcStatus.get().spriteEnabled())
-        drawSprites(line);
+    m_scheduler.get().schedule(SchedulerEvent::PPU_DRAW, m_frameStart + line * CYCLES_PER_LINE + H_BLANK_START);
 }
 
-void PictureProcessingUnit::drawBackground(uint8_t line)
+void PictureProcessingUnit::scheduleReadChange(uint32_t position)
 {
-    int backgroundLine = line + m_scrollY.value();
-
-    if (backgroundLine >= 255)
-        backgroundLine -= 255;
-
-    int tileIndex = (backgroundLine / 8) * 32;
-
-    int tileBaseIndex = tileIndex;
-
-    tileIndex += (m_scrollX.value() / 8);
-
-    int tileRowIndex = (backgroundLine % 8) * 2;
-
-    int tilePixelIndex = m_scrollX.value() % 8;
+    //A polling loop is only skipped up to the cycle at which the value it reads changes
+    uint64_t timestamp = m_frameStart + position;
+    if (timestamp < m_scheduler.get().deadline(SchedulerEvent::PPU_READ))
+        m_scheduler.get().schedule(SchedulerEvent::PPU_READ, timestamp);
+}
 
-    for (int framePixelIndex = 0; framePixelIndex < H_RES; framePixelIndex++)
+void PictureProcessingUnit::decodeDirtyTiles()
+{
+    for (int word = 0; word < m_dirtyTiles.size(); word++)
     {
-
-        // last pixel in current tile is reached, go to next tile
-        if (tilePixelIndex == 8)
+        while (m_dirtyTiles[word])
         {
-            tileIndex++;
-            
-            //warp around
-            if (tileIndex % 32 == 0)
+            int tile = word * 64 + __builtin_ctzll(m_dirtyTiles[word]);
+            m_dirtyTiles[word] &= m_dirtyTiles[word] - 1;
+
+            for (int row = 0; row < 8; row++)
             {
-                tileIndex -= 32;
+                uint8_t lowByte = m_vram[tile * TILE_SIZE + row * 2];
+                uint8_t highByte = m_vram[tile * TILE_SIZE + row * 2 + 1];
+
+                for (int pixel = 0; pixel < 8; pixel++)
+                {
+                    int bit = 7 - pixel;
+                    m_tileCache[tile][row][pixel] = ((lowByte >> bit) & 0x1) | (((highByte >> bit) & 0x1) << 1);
+                }
             }
-            tilePixelIndex = 0;
         }
+    }
+    m_hasDirtyTiles = false;
+}
 
+const uint8_t* PictureProcessingUnit::backgroundTileRow(int tileMapAddress, int tileRow)
+{
+    int tile = 0;
 
-        uint16_t tileAddress = 0;
+    // the pointer to the tile signed, tiles 128 - 383
+    if (m_lcdcStatus.get().bgWindowTileDataPointer() != 0)
+    {
+        int8_t tileMapPointer = m_vram[tileMapAddress];
+        tile = 256 + tileMapPointer;
+    }
+    else
+    {
+        tile = m_vram[tileMapAddress];
+    }
 
-        // the pointer to the tile signed
-        if (m_lcdcStatus.get().bgWindowTileDataPointer() != 0)
-        {
-            int8_t tileMapPointer = m_vram[m_lcdcStatus.get().backgroundTileMapPointer() + tileIndex];
-            tileAddress = m_lcdcStatus.get().bgWindowTileDataPointer() + ((tileMapPointer + 128) * 16);
-        }
-        else
-        {   
-            //Multiply by 16 since the tile is 16 bytes long and we need to space the index corretly
-            tileAddress = m_vram[m_lcdcStatus.get().backgroundTileMapPointer() + tileIndex] * 16;
-        }
-        
-        //Two bytes that represent the current row we are drawing, 2bpp
-        uint8_t lowByte = m_vram[tileAddress + tileRowIndex];
-        uint8_t highByte = m_vram[tileAddress + tileRowIndex + 1];
+    return m_tileCache[tile][tileRow];
+}
 
-        //the actually current Pixel in the row is tilePixelIndex, inverted so we can shift the bits into the pixel easily
-        int invertedTilePixelIndex = 7 - tilePixelIndex;
+void PictureProcessingUnit::drawLine(uint8_t line)
+{   
+    if (m_hasDirtyTiles) decodeDirtyTiles();
 
-        uint8_t pixel = 0;
-        pixel |= ((lowByte >> invertedTilePixelIndex) & 0x1);
-        pixel |= (((highByte >> invertedTilePixelIndex) & 0x1) << 1);
+    //Color indices of the line, padded so whole tile rows can be copied
+    uint8_t background[LINE_WIDTH + 8] = {};
+    uint8_t objects[LINE_WIDTH] = {};
 
-        switch(pixel)
-        {
-            case 0x0: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0xFF; break;
-            case 0x1: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0xCC; break;
-            case 0x2: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0x77; break;
-            case 0x3: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0x00; break;
-        }
-        
+    LinePalettes palettes;
+    applyPalette(m_pallet.value(), palettes.shades);
+    applyPalette(m_objectPalette0.value(), palettes.shades + 4);
+    applyPalette(m_objectPalette1.value(), palettes.shades + 8);
+
+    if (m_lcdcStatus.get().bgWindowPrioEnabled())     
+    {
+        drawBackground(line, background);
+
+        if (m_lcdcStatus.get().windowEnabled())
+            drawWindow(line, background);
+    }
+    else
+    {
+        //Without background the line is white, objects still show
+        memset(palettes.shades, 0, 4);
+    }
 
-        tilePixelIndex++;
+    if (m_lcdcStatus.get().spriteEnabled())
+    {
+        searchSprites(line);
+        drawSprites(line, objects);
     }
+
+    LineCompositor::compose(background, objects, palettes, frameBuffer[line]);
 }
 
-void PictureProcessingUnit::drawWindow(uint8_t line)
+void PictureProcessingUnit::applyPalette(uint8_t palette, uint8_t* shades)
 {
-    if (line < m_windowY.value()) return;
+    for (int color = 0; color < 4; color++)
+    {
+        shades[color] = (palette >> (color * 2)) & 0x3;
+    }
+}
 
-    int tileIndex = ((line - m_windowY.value()) / 8) * 32;
-    int tilePixelIndex = 0;
-    int tileBaseIndex = tileIndex;
+void PictureProcessingUnit::drawBackground(uint8_t line, uint8_t* colors)
+{
+    int backgroundLine = (line + m_scrollY.value()) & 0xFF;
+
+    int tileBaseIndex = (backgroundLine / 8) * 32;
+    int tileColumn = m_scrollX.value() / 8;
+    int tileRow = backgroundLine % 8;
+    int tileMapPointer = m_lcdcStatus.get().backgroundTileMapPointer();
 
-    int tileRowIndex = ((line - m_windowY.value()) % 8) * 2;
-    //start drawing from WX position
-    for (int framePixelIndex = m_windowX.value() - 7; framePixelIndex < H_RES; framePixelIndex++)
+    //21 tile rows cover the line for every fine scroll, the first pixels are skipped
+    uint8_t tileRows[(H_RES / 8 + 1) * 8];
+    for (int tile = 0; tile <= H_RES / 8; tile++)
     {
-        //reached the end of the row, continue with next tile
-        if (tilePixelIndex == 8)
-        {
-            tilePixelIndex = 0;
-            tileIndex++;
-        }
+        //warp around
+        int tileIndex = tileBaseIndex + ((tileColumn + tile) % 32);
+        memcpy(tileRows + tile * 8, backgroundTileRow(tileMapPointer + tileIndex, tileRow), 8);
+    }
 
-        if ((tileBaseIndex - tileIndex) == 32)
-            tileIndex = 0;
+    memcpy(colors, tileRows + m_scrollX.value() % 8, H_RES);
+}
 
-        int16_t tileAddress = 0;
+void PictureProcessingUnit::drawWindow(uint8_t line, uint8_t* colors)
+{
+    if (line < m_windowY.value()) return;
 
-        // the pointer to the tile signed
-        if (m_lcdcStatus.get().bgWindowTileDataPointer() != 0)
-        {
-            int8_t tileMapPointer = m_vram[m_lcdcStatus.get().windowTileMapPointer() + tileIndex];
-            tileAddress = m_lcdcStatus.get().bgWindowTileDataPointer() + ((tileMapPointer + 128) * 16);
-        }
-        else
-        {   
-            //Multiply by 16 since the tile is 16 bytes long and we need to space the index corretly
-            tileAddress = m_vram[m_lcdcStatus.get().windowTileMapPointer() + tileIndex] * 16;
-        }
-        
-        //Two bytes that represent the current row we are drawing, 2bpp
-        uint8_t lowByte = m_vram[tileAddress + tileRowIndex];
-        uint8_t highByte = m_vram[tileAddress + tileRowIndex + 1];
+    //The window starts at WX - 7, pixels left of the screen are skipped
+    int windowStart = m_windowX.value() - 7;
+    if (windowStart >= H_RES) return;
 
-        //the actually current Pixel in the row is tilePixelIndex, inverted so we can shift the bits into the pixel easily
-        int invertedTilePixelIndex = 7 - tilePixelIndex;
+    int tileBaseIndex = ((line - m_windowY.value()) / 8) * 32;
+    int tileRow = (line - m_windowY.value()) % 8;
+    int tileMapPointer = m_lcdcStatus.get().windowTileMapPointer();
 
-        uint8_t pixel = 0;
-        pixel |= ((lowByte >> invertedTilePixelIndex) & 0x1);
-        pixel |= (((highByte >> invertedTilePixelIndex) & 0x1) << 1);
+    int firstTile = windowStart < 0 ? -windowStart / 8 : 0;
+    int lastTile = (H_RES - 1 - windowStart) / 8;
 
-        switch(pixel)
-        {
-            case 0x0: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0xFF; break;
-            case 0x1: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0xCC; break;
-            case 0x2: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0x77; break;
-            case 0x3: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0x00; break;
-        }
+    for (int tile = firstTile; tile <= lastTile; tile++)
+    {
+        const uint8_t* tilePixels = backgroundTileRow(tileMapPointer + tileBaseIndex + tile, tileRow);
+        int framePixelIndex = windowStart + tile * 8;
+        int skip = framePixelIndex < 0 ? -framePixelIndex : 0;
 
-        tilePixelIndex++;
+        //The last tile row may run into the padding behind the line
+        memcpy(colors + framePixelIndex + skip, tilePixels + skip, 8 - skip);
     }
 }
 
-void PictureProcessingUnit::drawSprites(uint8_t line)
+void PictureProcessingUnit::drawSprites(uint8_t line, uint8_t* objects)
 {
+    uint8_t spriteSize = m_lcdcStatus.get().spriteSize();
 
-    for (int i = 0; i < m_spritesInLine; i++)
+    //Sprites sorted first have priority, so they are drawn last
+    for (int i = m_spritesInLine - 1; i >= 0; i--)
     {
-        int tileRowIndex = line - m_sprites[i].yPosition;
-        
-        int tileIndex = 0;
+        const Sprite& sprite = m_sprites[i];
 
-        tileRowIndex *= 2;
-        //Multiply by 16 since the tile is 16 bytes long and we need to space the index corretly
-        int tilePointer = m_sprites[i].tilePointer * 16;
-        
-        //Two bytes that represent the current row we are drawing, 2bpp
-        uint8_t lowByte = m_vram[tilePointer + tileRowIndex];
-        uint8_t highByte = m_vram[tilePointer + tileRowIndex + 1];
+        int tileRowIndex = line + SPRITE_Y_OFFSET - sprite.yPosition;
+        if (sprite.isVerticalFlipped()) tileRowIndex = spriteSize - 1 - tileRowIndex;
 
-        //Draw sprite row
-        for (int tileRowPixelIndex = 0; tileRowPixelIndex < 8; ++tileRowPixelIndex)
-        {
-            //the actually current Pixel in the row is tilePixelIndex, inverted so we can shift the bits into the pixel easily
-            int invertedTilePixelIndex = m_sprites[i].isHorizontalFlipped()? tileRowPixelIndex : (7 - (tileRowPixelIndex % 8));
+        //The lower half of 8x16 sprites is the following tile
+        int tile = spriteSize == 16 ? sprite.tilePointer & 0xFE : sprite.tilePointer;
+        const uint8_t* tilePixels = m_tileCache[tile + tileRowIndex / 8][tileRowIndex % 8];
 
-            uint8_t pixel = 0;
-            pixel |= ((lowByte >> invertedTilePixelIndex) & 0x1);
-            pixel |= (((highByte >> invertedTilePixelIndex) & 0x1) << 1);
+        uint8_t attributes = (sprite.usesPalette1() ? OBJECT_PALETTE_1 : 0) | (sprite.isBehindBgWindow() ? OBJECT_BEHIND_BG : 0);
 
-            int framePixelIndex = m_sprites[i].xPosition + tileRowPixelIndex;
+        //Pixels left of the screen are clipped
+        int firstPixel = sprite.xPosition < SPRITE_X_OFFSET ? SPRITE_X_OFFSET - sprite.xPosition : 0;
+        for (int tileRowPixelIndex = firstPixel; tileRowPixelIndex < 8; ++tileRowPixelIndex)
+        {
+            int framePixelIndex = sprite.xPosition - SPRITE_X_OFFSET + tileRowPixelIndex;
+            if (framePixelIndex >= H_RES) break;
 
-            switch(pixel)
-            {
-                case 0x0: break;
-                case 0x1: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0xCC; break;
-                case 0x2: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0x77; break;
-                case 0x3: screenData[line][framePixelIndex][0] = screenData[line][framePixelIndex][1] = screenData[line][framePixelIndex][2] = 0x00; break;
-                default : assert(false);
-            }
+            uint8_t pixel = tilePixels[sprite.isHorizontalFlipped()? 7 - tileRowPixelIndex : tileRowPixelIndex];
+
+            //Color 0 is transparent and shows the sprites below
+            if (pixel != 0) objects[framePixelIndex] = pixel | attributes;
         }    
     }
 }
@@ -351,33 +554,30 @@ void PictureProcessingUnit::drawSprites(uint8_t line)
 void PictureProcessingUnit::searchSprites(uint8_t line)
 {
     m_spritesInLine = 0;
+    int spriteSize = m_lcdcStatus.get().spriteSize();
 
-    for (int yPosIndex = 0; yPosIndex < OAM_SIZE; yPosIndex += 4)
+    //The first SPRITE_LIMIT sprites on the line count, also those outside the screen horizontally
+    for (int index = 0; index < OAM_SIZE && m_spritesInLine < SPRITE_LIMIT; index += 4)
     {
-        int spritePositionY = m_oam[yPosIndex];
-        int spritePositionX = m_oam[yPosIndex + 1];
-        
-        spritePositionY -= 16;
-        spritePositionX -= 8;
-        
-        if (spritePositionY < 0 || spritePositionX < 0)
-            continue;
+        int spriteTop = m_oam[index] - SPRITE_Y_OFFSET;
+        if (line < spriteTop || line >= spriteTop + spriteSize) continue;
+
+        Sprite& sprite = m_sprites[m_spritesInLine++];
+        sprite.yPosition = m_oam[index];
+        sprite.xPosition = m_oam[index + 1];
+        sprite.tilePointer = m_oam[index + 2];
+        sprite.attributes = m_oam[index + 3];
+    }
 
-        if (line >= spritePositionY && line < (spritePositionY + m_lcdcStatus.get().spriteSize()))
+    //On overlap the sprite with the lower X wins, then the one first in OAM, so the sort has to be stable
+    for (int i = 1; i < m_spritesInLine; i++)
+    {
+        Sprite sprite = m_sprites[i];
+        int position = i;
+        for (; position > 0 && m_sprites[position - 1].xPosition > sprite.xPosition; position--)
         {
-            if (m_spritesInLine == 10)
-                break;
-
-            m_sprites[m_spritesInLine].yPosition = m_oam[yPosIndex];
-            m_sprites[m_spritesInLine].xPosition = m_oam[yPosIndex + 1];
-            m_sprites[m_spritesInLine].tilePointer = m_oam[yPosIndex + 2];
-            m_sprites[m_spritesInLine].attributes = m_oam[yPosIndex + 3];
-            m_sprites[m_spritesInLine].yPosition -= 16;
-            m_sprites[m_spritesInLine].xPosition -= 8;
-            
-            m_spritesInLine++;
-            
+            m_sprites[position] = m_sprites[position - 1];
         }
+        m_sprites[position] = sprite;
     }
 }
-
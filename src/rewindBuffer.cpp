@@ -0,0 +1,183 @@
+#include "../include/rewindBuffer.hpp"
+
+#include <cstring>
+
+//Unchanged bytes shorter than this stay inside the changed run, a new pair costs at least two bytes
+#define MIN_UNCHANGED_RUN 4
+
+static void writeVarint(std::vector<uint8_t>& out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((uint8_t)value | 0x80);
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static bool readVarint(const uint8_t*& data, const uint8_t* end, size_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; data < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *data++;
+        value |= (size_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static inline bool wordEqual(const uint8_t* a, const uint8_t* b)
+{
+    uint64_t wordA, wordB;
+    memcpy(&wordA, a, sizeof(wordA));
+    memcpy(&wordB, b, sizeof(wordB));
+    return wordA == wordB;
+}
+
+RewindBuffer::RewindBuffer(size_t capacity, unsigned interval) :
+    m_storage(capacity), m_interval(interval ? interval : 1)
+{ }
+
+void RewindBuffer::encode(const uint8_t* state, const uint8_t* previous, size_t size, std::vector<uint8_t>& delta)
+{
+    delta.clear();
+
+    size_t position = 0;
+    while (position < size)
+    {
+        //Unchanged run, a word at a time while possible
+        size_t unchangedStart = position;
+        while (position + 8 <= size && wordEqual(state + position, previous + position)) position += 8;
+        while (position < size && state[position] == previous[position]) position++;
+
+        if (position == size) break;
+
+        //Changed run, ends before MIN_UNCHANGED_RUN unchanged bytes in a row
+        size_t changedStart = position;
+        size_t unchanged = 0;
+        while (position < size)
+        {
+            if (state[position] != previous[position]) unchanged = 0;
+            else if (++unchanged == MIN_UNCHANGED_RUN)
+            {
+                position -= MIN_UNCHANGED_RUN - 1;
+                break;
+            }
+            position++;
+        }
+
+        writeVarint(delta, changedStart - unchangedStart);
+        writeVarint(delta, position - changedStart);
+        for (size_t i = changedStart; i < position; i++)
+        {
+            delta.push_back(state[i] ^ previous[i]);
+        }
+    }
+}
+
+bool RewindBuffer::decode(const uint8_t* delta, size_t deltaSize, uint8_t* state, size_t size)
+{
+    const uint8_t* end = delta + deltaSize;
+    size_t position = 0;
+
+    while (delta < end)
+    {
+        size_t unchanged, changed;
+        if (!readVarint(delta, end, unchanged) || !readVarint(delta, end, changed)) return false;
+        if (unchanged > size - position) return false;
+        position += unchanged;
+        if (changed > size - position || changed > (size_t)(end - delta)) return false;
+
+        for (size_t i = 0; i < changed; i++)
+        {
+            state[position++] ^= *delta++;
+        }
+    }
+    return true;
+}
+
+void RewindBuffer::append(const std::vector<uint8_t>& delta)
+{
+    //An entry that does not fit at all breaks the chain, older entries can not be reached
+    if (delta.size() > m_storage.size())
+    {
+        m_entries.clear();
+        m_writeOffset = 0;
+        return;
+    }
+
+    if (m_writeOffset + delta.size() > m_storage.size())
+    {
+        //The oldest entries lie behind the write offset, they are overwritten before the ones at the start
+        while (!m_entries.empty() && m_entries.front().offset >= m_writeOffset)
+        {
+            m_entries.pop_front();
+        }
+        m_writeOffset = 0;
+    }
+
+    //The free space ends at the oldest entry
+    size_t end = m_writeOffset + delta.size();
+    while (!m_entries.empty() && m_entries.front().offset < end && m_entries.front().offset + m_entries.front().size > m_writeOffset)
+    {
+        m_entries.pop_front();
+    }
+
+    memcpy(m_storage.data() + m_writeOffset, delta.data(), delta.size());
+    m_entries.push_back({ m_writeOffset, delta.size() });
+    m_writeOffset = end;
+}
+
+void RewindBuffer::capture(GameBoy& gameBoy)
+{
+    gameBoy.snapshot(m_next);
+
+    if (m_current.size() == m_next.size())
+    {
+        //Applied to the new state the delta gives back the current one
+        encode(m_next.data(), m_current.data(), m_next.size(), m_delta);
+        append(m_delta);
+    }
+    else
+    {
+        m_entries.clear();
+        m_writeOffset = 0;
+    }
+
+    m_current.swap(m_next);
+}
+
+bool RewindBuffer::rewind(GameBoy& gameBoy)
+{
+    if (m_entries.empty()) return false;
+
+    Entry entry = m_entries.back();
+    m_entries.pop_back();
+    m_writeOffset = entry.offset;
+
+    if (!decode(m_storage.data() + entry.offset, entry.size, m_current.data(), m_current.size()))
+    {
+        clear();
+        return false;
+    }
+
+    return gameBoy.restore(m_current);
+}
+
+void RewindBuffer::clear()
+{
+    m_entries.clear();
+    m_writeOffset = 0;
+    m_current.clear();
+}
+
+size_t RewindBuffer::usedBytes() const
+{
+    size_t bytes = 0;
+    for (const Entry& entry : m_entries)
+    {
+        bytes += entry.size;
+    }
+    return bytes;
+}
@@ -0,0 +1,168 @@
+#include "../include/saveState.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define GBEMU_HAS_MMAP
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+static uint64_t alignUp(uint64_t value)
+{
+    return (value + SAVE_STATE_ALIGNMENT - 1) & ~(uint64_t)(SAVE_STATE_ALIGNMENT - 1);
+}
+
+uint32_t SaveState::sectionVersion(StateSection section)
+{
+    switch(section)
+    {
+        //LY and STAT are derived from the frame start instead of stored at each mode change
+        case StateSection::LCD_STATUS:
+        case StateSection::PPU:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void SaveState::romIdentity(GameBoy& gameBoy, SaveStateHeader& header)
+{
+    for (uint16_t i = 0; i < sizeof(header.title); i++)
+    {
+        header.title[i] = gameBoy.memoryBus().readMemoryBus(0x134 + i);
+    }
+    header.globalChecksum = (gameBoy.memoryBus().readMemoryBus(0x14E) << 8) | gameBoy.memoryBus().readMemoryBus(0x14F);
+}
+
+bool SaveState::write(GameBoy& gameBoy, const char* fileName)
+{
+    SaveStateHeader header = {};
+    memcpy(header.magic, SAVE_STATE_MAGIC, sizeof(header.magic));
+    header.formatVersion = SAVE_STATE_FORMAT_VERSION;
+    header.sectionCount = (uint32_t)StateSection::SECTION_COUNT;
+    romIdentity(gameBoy, header);
+
+    std::vector<std::vector<uint8_t>> sectionData(header.sectionCount);
+    std::vector<SaveStateSection> sections(header.sectionCount);
+
+    uint64_t offset = alignUp(sizeof(SaveStateHeader) + sizeof(SaveStateSection) * header.sectionCount);
+    for (uint32_t id = 0; id < header.sectionCount; id++)
+    {
+        StateArchive archive(sectionData[id]);
+        gameBoy.serializeSection((StateSection)id, archive);
+        archive.finish();
+
+        sections[id].id = id;
+        sections[id].version = sectionVersion((StateSection)id);
+        sections[id].offset = offset;
+        sections[id].size = sectionData[id].size();
+        offset = alignUp(offset + sections[id].size);
+    }
+
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    static const char padding[SAVE_STATE_ALIGNMENT] = {};
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)sections.data(), sizeof(SaveStateSection) * sections.size());
+
+    for (uint32_t id = 0; id < header.sectionCount; id++)
+    {
+        file.write(padding, sections[id].offset - file.tellp());
+        file.write((const char*)sectionData[id].data(), sectionData[id].size());
+    }
+    file.write(padding, offset - file.tellp());
+
+    return file.good();
+}
+
+bool SaveState::read(GameBoy& gameBoy, const char* fileName)
+{
+#ifdef GBEMU_HAS_MMAP
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = fileStat.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    bool result = load(gameBoy, (const uint8_t*)data, size);
+    munmap(data, size);
+    return result;
+#else
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+
+    std::vector<uint8_t> data(file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read((char*)data.data(), data.size());
+    if (!file) return false;
+
+    return load(gameBoy, data.data(), data.size());
+#endif
+}
+
+bool SaveState::load(GameBoy& gameBoy, const uint8_t* data, size_t size)
+{
+    if (size < sizeof(SaveStateHeader)) return false;
+
+    SaveStateHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, SAVE_STATE_MAGIC, sizeof(header.magic)) != 0) return false;
+    if (header.formatVersion > SAVE_STATE_FORMAT_VERSION) return false;
+    if (sizeof(SaveStateHeader) + sizeof(SaveStateSection) * (uint64_t)header.sectionCount > size) return false;
+
+    SaveStateHeader identity = {};
+    romIdentity(gameBoy, identity);
+    if (memcmp(header.title, identity.title, sizeof(header.title)) != 0 || header.globalChecksum != identity.globalChecksum) return false;
+
+    //Validate the whole table first, so a bad file leaves the machine untouched
+    std::vector<SaveStateSection> sections(header.sectionCount);
+    memcpy(sections.data(), data + sizeof(SaveStateHeader), sizeof(SaveStateSection) * sections.size());
+
+    for (const SaveStateSection& section : sections)
+    {
+        if (section.offset > size || section.size > size - section.offset) return false;
+        if (section.id < (uint32_t)StateSection::SECTION_COUNT && section.version > sectionVersion((StateSection)section.id)) return false;
+    }
+
+    //A section that does not match its layout can only be detected while loading it
+    std::vector<uint8_t> previousState;
+    gameBoy.snapshot(previousState);
+
+    //Restore in section order, independent of the order in the file
+    for (uint32_t id = 0; id < (uint32_t)StateSection::SECTION_COUNT; id++)
+    {
+        for (const SaveStateSection& section : sections)
+        {
+            if (section.id != id) continue;
+
+            StateArchive archive(data + section.offset, section.size, section.version);
+            gameBoy.serializeSection((StateSection)id, archive);
+
+            if (archive.overrun() || archive.position() != section.size)
+            {
+                gameBoy.restore(previousState);
+                return false;
+            }
+            break;
+        }
+    }
+
+    return true;
+}
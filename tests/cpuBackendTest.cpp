@@ -0,0 +1,311 @@
+#include <cstdio>
+#include <vector>
+
+#include "gameBoy.hpp"
+#include "Cartridge/cartridgeBuilder.hpp"
+
+#include "romImage.hpp"
+
+//Frames until the boot ROM handed over and the test program settled
+#define TEST_FRAMES 900
+
+#define RESULT_ADDRESS 0xC000
+
+//Instructions of the random program, it fills most of bank 0
+#define RANDOM_INSTRUCTIONS 4500
+//Subroutine the random program calls, it may return early depending on C
+#define RANDOM_SUBROUTINE 0x3F00
+
+//Every backend is compared against the interpreter
+static const std::pair<CpuBackend, const char*> BACKENDS[] = {
+    { CpuBackend::DECODED_BLOCKS, "decoded blocks" },
+#ifdef GBEMU_JIT
+    { CpuBackend::JIT, "jit" },
+#endif
+};
+
+//Fixed seed, every run generates the same program
+static uint32_t nextRandom(uint32_t& seed)
+{
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+static bool sameState(const char* name, GameBoy& expected, GameBoy& actual)
+{
+    std::vector<uint8_t> expectedState, actualState;
+    expected.snapshot(expectedState);
+    actual.snapshot(actualState);
+    if (expectedState != actualState)
+    {
+        printf("%s: the snapshots differ after frame %llu\n", name, (unsigned long long)expected.frameCount());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Every CPU backend has to leave the machine in the same state. Each test runs a ROM
+ * on an interpreter instance and one instance per other backend and compares the
+ * result and the full snapshots.
+ *
+ * @param expected Value the program leaves at RESULT_ADDRESS, -1 to only compare the snapshots
+ */
+static bool runBackends(const char* name, const std::string& romFile, int expected)
+{
+    GameBoy interpreter(CartridgeBuilder::openROM(romFile.c_str()));
+    interpreter.setCpuBackend(CpuBackend::INTERPRETER);
+
+    bool passed = true;
+    for (const auto& [backend, backendName] : BACKENDS)
+    {
+        GameBoy reference(CartridgeBuilder::openROM(romFile.c_str()));
+        GameBoy other(CartridgeBuilder::openROM(romFile.c_str()));
+        reference.setCpuBackend(CpuBackend::INTERPRETER);
+        other.setCpuBackend(backend);
+
+        std::string otherName = std::string(name) + ", " + backendName;
+        bool same = true;
+        for (int frame = 0; frame < TEST_FRAMES && same; frame++)
+        {
+            reference.runFrame();
+            other.runFrame();
+            if (frame % 50 == 0) same = sameState(otherName.c_str(), reference, other);
+        }
+        if (!same || !sameState(otherName.c_str(), reference, other))
+        {
+            passed = false;
+            continue;
+        }
+
+        uint8_t referenceResult = reference.memoryBus().readMemoryBus(RESULT_ADDRESS);
+        uint8_t otherResult = other.memoryBus().readMemoryBus(RESULT_ADDRESS);
+        if (expected >= 0 && (referenceResult != expected || otherResult != expected))
+        {
+            printf("%s: expected %02X, the interpreter wrote %02X, %s wrote %02X\n", otherName.c_str(), expected, referenceResult, backendName, otherResult);
+            passed = false;
+        }
+    }
+
+    if (passed) printf("%s: passed\n", name);
+    return passed;
+}
+
+//Code in bank 1 switches to bank 2 and continues at the next address of the new bank
+static bool testBankSwitchFromSwitchableBank()
+{
+    RomImage image(ROM_TYPE_MBC1, 4);
+
+    //JP 0x4000
+    image.place(ROM_PROGRAM_START, { 0xC3, 0x00, 0x40 });
+
+    //LD A,2; LD (0x2000),A; LD A,0x11; LD (RESULT_ADDRESS),A; JR -2
+    image.place(0x4000, { 0x3E, 0x02, 0xEA, 0x00, 0x20, 0x3E, 0x11, 0xEA, 0x00, 0xC0, 0x18, 0xFE });
+    //Bank 2 from 0x4005 on: LD A,0x22; LD (RESULT_ADDRESS),A; JR -2
+    image.place(0x8005, { 0x3E, 0x22, 0xEA, 0x00, 0xC0, 0x18, 0xFE });
+
+    std::string romFile = image.write("gbemu_bank_switch_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return false;
+    }
+    return runBackends("bank switch from the switchable bank", romFile, 0x22);
+}
+
+/**
+ * Runs a random mix of nearly every instruction in a loop: register and memory loads, the
+ * ALU, rotations and bit operations, the stack, and jumps, calls and returns that are
+ * taken or not depending on the flags. Memory accesses only go to WRAM and HRAM.
+ */
+static bool testRandomInstructions()
+{
+    RomImage image(ROM_TYPE_STANDARD);
+    //DI, then LD SP,0xDFF0 at the start of every pass
+    std::vector<uint8_t> program = { 0xF3 };
+    const uint16_t loopAddress = ROM_PROGRAM_START + program.size();
+    program.insert(program.end(), { 0x31, 0xF0, 0xDF });
+
+    //The registers B, C, D, E, H, L and A as numbered in the opcodes
+    static const uint8_t registers[] = { 0, 1, 2, 3, 4, 5, 7 };
+    uint32_t seed = 22;
+    auto random = [&](uint32_t range) { return nextRandom(seed) % range; };
+    auto anyRegister = [&]() { return registers[random(sizeof(registers))]; };
+    //Half of the immediates are values where the flags change, uniform bytes are rarely zero
+    static const uint8_t edgeValues[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0xF0, 0xFF };
+    auto anyValue = [&]() { return (uint8_t)(random(2) ? edgeValues[random(sizeof(edgeValues))] : random(256)); };
+    auto emit = [&](std::initializer_list<uint8_t> bytes) { program.insert(program.end(), bytes); };
+    auto emitPointer = [&](uint8_t opCode, uint16_t base, uint16_t range) {
+        uint16_t address = base + random(range);
+        emit({ opCode, (uint8_t)address, (uint8_t)(address >> 8) });
+    };
+
+    for (int i = 0; i < RANDOM_INSTRUCTIONS; i++)
+    {
+        uint16_t address = ROM_PROGRAM_START + program.size();
+        switch (random(16))
+        {
+            //LD r,r', INC r, DEC r and the ALU on registers
+            case 0: emit({ (uint8_t)(0x40 | anyRegister() << 3 | anyRegister()) }); break;
+            case 1: emit({ (uint8_t)(0x04 | anyRegister() << 3 | random(2)) }); break;
+            case 2: case 3: emit({ (uint8_t)(0x80 | random(8) << 3 | anyRegister()) }); break;
+            //LD r,n and the ALU with an immediate
+            case 4: emit({ (uint8_t)(0x06 | anyRegister() << 3), anyValue() }); break;
+            case 5: emit({ (uint8_t)(0xC6 | random(8) << 3), anyValue() }); break;
+            //Rotations of A, DAA, CPL, SCF, CCF and the CB operations on registers, half of them
+            //on a value loaded right before
+            case 6: emit({ (uint8_t)(0x07 | random(8) << 3) }); break;
+            case 7:
+            {
+                uint8_t operand = anyRegister();
+                if (random(2)) emit({ (uint8_t)(0x06 | operand << 3), anyValue() });
+                emit({ 0xCB, (uint8_t)(random(256) & 0xF8 | operand) });
+                break;
+            }
+            //INC rr, DEC rr, ADD HL,rr and LD rr,nn without SP
+            case 8:
+            {
+                uint8_t pair = random(3) << 4;
+                static const uint8_t operations[] = { 0x03, 0x0B, 0x09, 0x01 };
+                uint8_t operation = operations[random(4)];
+                if (operation == 0x01) emit({ (uint8_t)(operation | pair), (uint8_t)random(256), (uint8_t)random(256) });
+                else emit({ (uint8_t)(operation | pair) });
+                break;
+            }
+            //An operation on (HL) somewhere in WRAM
+            case 9:
+            {
+                emitPointer(0x21, 0xC100, 0x1000);
+                static const uint8_t operations[] = { 0x46, 0x70, 0x36, 0x34, 0x35, 0x86, 0xCB, 0x22, 0x2A, 0x32, 0x3A };
+                uint8_t operation = operations[random(sizeof(operations))];
+                if (operation == 0x46 || operation == 0x70) emit({ (uint8_t)(operation | (operation == 0x46 ? anyRegister() << 3 : anyRegister())) });
+                else if (operation == 0x86) emit({ (uint8_t)(operation | random(8) << 3) });
+                else if (operation == 0x36) emit({ operation, anyValue() });
+                else if (operation == 0xCB) emit({ operation, (uint8_t)(random(256) & 0xF8 | 0x06) });
+                else emit({ operation });
+                break;
+            }
+            //Loads through BC and DE, LD (nn),A and LD A,(nn), LDH and LD (C)
+            case 10:
+                switch (random(4))
+                {
+                    case 0:
+                        emitPointer(random(2) ? 0x01 : 0x11, 0xC100, 0x1000);
+                        emit({ (uint8_t)(0x02 | random(2) << 4 | random(2) << 3) });
+                        break;
+                    case 1: emitPointer(random(2) ? 0xEA : 0xFA, 0xC100, 0x1000); break;
+                    case 2: emit({ (uint8_t)(random(2) ? 0xE0 : 0xF0), (uint8_t)(0x80 + random(0x70)) }); break;
+                    case 3: emit({ 0x0E, (uint8_t)(0x80 + random(0x70)), (uint8_t)(random(2) ? 0xE2 : 0xF2) }); break;
+                }
+                break;
+            //PUSH and a POP, which can be another pair, AF drops the lower nibble of F
+            case 11: emit({ (uint8_t)(0xC5 | random(4) << 4), (uint8_t)(0xC1 | random(4) << 4) }); break;
+            //JR cc over an INC B, JP cc over an INC C
+            case 12: emit({ (uint8_t)(0x20 | random(4) << 3), 0x01, 0x04 }); break;
+            case 13:
+            {
+                uint16_t target = address + 4;
+                emit({ (uint8_t)(0xC2 | random(4) << 3), (uint8_t)target, (uint8_t)(target >> 8), 0x0C });
+                break;
+            }
+            //CALL and CALL cc of the subroutine, RST 0x08, JP (HL) to the next instruction
+            case 14:
+                switch (random(3))
+                {
+                    case 0: emit({ (uint8_t)(random(2) ? 0xCD : 0xC4 | random(4) << 3), RANDOM_SUBROUTINE & 0xFF, RANDOM_SUBROUTINE >> 8 }); break;
+                    case 1: emit({ 0xCF }); break;
+                    case 2:
+                    {
+                        uint16_t target = address + 4;
+                        emit({ 0x21, (uint8_t)target, (uint8_t)(target >> 8), 0xE9 });
+                        break;
+                    }
+                }
+                break;
+            //LD HL,SP+e, ADD SP,e and back, LD (nn),SP
+            case 15:
+                switch (random(3))
+                {
+                    case 0: emit({ 0xF8, (uint8_t)random(256) }); break;
+                    case 1:
+                    {
+                        uint8_t offset = random(256);
+                        emit({ 0xE8, offset, 0xE8, (uint8_t)-offset });
+                        break;
+                    }
+                    case 2: emitPointer(0x08, 0xC100, 0x1000); break;
+                }
+                break;
+        }
+
+        //PUSH AF without a POP leaves A and F of every other instruction on the stack, a
+        //wrong flag would otherwise be overwritten long before the snapshots are compared
+        if (random(2)) emit({ 0xF5 });
+    }
+
+    //JP to the start of the loop
+    emit({ 0xC3, (uint8_t)loopAddress, (uint8_t)(loopAddress >> 8) });
+    image.place(ROM_PROGRAM_START, program);
+    //RET NC; INC D; RET
+    image.place(RANDOM_SUBROUTINE, { 0xD0, 0x14, 0xC9 });
+    //RST 0x08: INC E; RET
+    image.place(0x08, { 0x1C, 0xC9 });
+
+    std::string romFile = image.write("gbemu_random_instructions_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return false;
+    }
+    return runBackends("random instructions", romFile, -1);
+}
+
+//Switching the backend at any frame must not change what the machine does
+static bool testBackendSwitchEveryFrame()
+{
+    RomImage image(ROM_TYPE_STANDARD);
+
+    //Writes INC A; RET to 0xC100 and calls it in an arithmetic loop, which rewrites the
+    //INC to a DEC every other iteration, so decoded WRAM code gets invalidated
+    image.place(ROM_PROGRAM_START, {
+        0xF3, 0x31, 0xFE, 0xFF, 0x21, 0x00, 0xC1, 0x36, 0x3C, 0x23, 0x36, 0xC9, 0x0E, 0x13,
+        0x81, 0x8A, 0x27, 0x93, 0xCD, 0x00, 0xC1, 0xF5, 0xF1, 0x0C, 0x79, 0xEA, 0x00, 0xC0,
+        0xE6, 0x01, 0xC6, 0x3C, 0xEA, 0x00, 0xC1, 0x18, 0xE9
+    });
+
+    std::string romFile = image.write("gbemu_backend_switch_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return false;
+    }
+
+    const char* name = "backend switch every frame";
+    GameBoy interpreter(CartridgeBuilder::openROM(romFile.c_str()));
+    GameBoy switching(CartridgeBuilder::openROM(romFile.c_str()));
+    interpreter.setCpuBackend(CpuBackend::INTERPRETER);
+
+    const size_t backends = sizeof(BACKENDS) / sizeof(BACKENDS[0]) + 1;
+    for (int frame = 0; frame < TEST_FRAMES; frame++)
+    {
+        size_t backend = frame % backends;
+        switching.setCpuBackend(backend ? BACKENDS[backend - 1].first : CpuBackend::INTERPRETER);
+        interpreter.runFrame();
+        switching.runFrame();
+
+        if (frame % 50 == 0 && !sameState(name, interpreter, switching)) return false;
+    }
+    if (!sameState(name, interpreter, switching)) return false;
+
+    printf("%s: passed\n", name);
+    return true;
+}
+
+int main()
+{
+    bool passed = true;
+    passed &= testBankSwitchFromSwitchableBank();
+    passed &= testRandomInstructions();
+    passed &= testBackendSwitchEveryFrame();
+    return passed ? 0 : 1;
+}
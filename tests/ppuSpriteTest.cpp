@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <vector>
+
+#include "gameBoy.hpp"
+#include "Cartridge/cartridgeBuilder.hpp"
+
+#include "romImage.hpp"
+
+//Upper bound for the boot ROM to hand over
+#define BOOT_FRAMES 1000
+
+#define READY_ADDRESS 0xC000
+#define READY_VALUE 0x42
+
+struct ExpectedPixel
+{
+    int line;
+    int x;
+    uint8_t shade;
+};
+
+static void writeSprite(MemoryBus& bus, int index, uint8_t y, uint8_t x, uint8_t tile, uint8_t attributes)
+{
+    bus.writeMemoryBus(OAM_ADDRESS + index * 4, y);
+    bus.writeMemoryBus(OAM_ADDRESS + index * 4 + 1, x);
+    bus.writeMemoryBus(OAM_ADDRESS + index * 4 + 2, tile);
+    bus.writeMemoryBus(OAM_ADDRESS + index * 4 + 3, attributes);
+}
+
+/**
+ * Sets up sprites with the LCD off, turns it on and checks the drawn frame: a sprite
+ * partly above and left of the screen is clipped, and of two overlapping sprites the
+ * one with the lower X wins although it comes later in OAM.
+ */
+int main()
+{
+    RomImage image(ROM_TYPE_STANDARD);
+    //DI; XOR A; LDH (0x40),A; LD A,READY_VALUE; LD (READY_ADDRESS),A; JR -2
+    image.place(ROM_PROGRAM_START, { 0xF3, 0xAF, 0xE0, 0x40, 0x3E, READY_VALUE, 0xEA, 0x00, 0xC0, 0x18, 0xFE });
+
+    std::string romFile = image.write("gbemu_ppu_sprite_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return 1;
+    }
+
+    GameBoy gameBoy(CartridgeBuilder::openROM(romFile.c_str()));
+    MemoryBus& bus = gameBoy.memoryBus();
+    for (int frame = 0; frame < BOOT_FRAMES && bus.readMemoryBus(READY_ADDRESS) != READY_VALUE; frame++)
+    {
+        gameBoy.runFrame();
+    }
+    if (bus.readMemoryBus(READY_ADDRESS) != READY_VALUE)
+    {
+        printf("The test program did not start\n");
+        return 1;
+    }
+
+    //Tile 1 is color 3 everywhere, the background shows tile 0 in color 0
+    for (uint16_t address = VRAM_ADDRESS; address < VRAM_ADDRESS + VRAM_SIZE; address++)
+    {
+        bus.writeMemoryBus(address, address >= VRAM_ADDRESS + TILE_SIZE && address < VRAM_ADDRESS + 2 * TILE_SIZE ? 0xFF : 0x00);
+    }
+    bus.writeMemoryBus(LCD_SCY_ADDRESS, 0);
+    bus.writeMemoryBus(LCD_SCX_ADDRESS, 0);
+    bus.writeMemoryBus(LCD_PALLET_ADDRESS, 0xE4);
+    //OBP0 maps color 3 to shade 3, OBP1 to shade 1
+    bus.writeMemoryBus(0xFF48, 0xE4);
+    bus.writeMemoryBus(0xFF49, 0x54);
+
+    for (int index = 0; index < OAM_SIZE / 4; index++) writeSprite(bus, index, 0, 0, 0, 0);
+    //Overlapping on line 20 at x 32-35, the first in OAM has the higher X and loses there
+    writeSprite(bus, 0, SPRITE_Y_OFFSET + 20, SPRITE_X_OFFSET + 32, 1, 0x10);
+    writeSprite(bus, 1, SPRITE_Y_OFFSET + 20, SPRITE_X_OFFSET + 28, 1, 0x00);
+    //6 lines above and 4 pixels left of the screen, the rest shows at lines 0-1 and x 0-3
+    writeSprite(bus, 2, SPRITE_Y_OFFSET - 6, SPRITE_X_OFFSET - 4, 1, 0x00);
+
+    bus.writeMemoryBus(LCDC_CONTROL_ADDRESS, PPU_ENABLE_FLAG | BG_WINDOW_TILE_AREA_FLAG | SPRITE_ENABLE_FLAG | BG_WINDOW_PRIO_FLAG);
+    gameBoy.runFrame();
+    gameBoy.runFrame();
+
+    const ExpectedPixel expected[] = {
+        { 0, 0, 3 }, { 0, 3, 3 }, { 0, 4, 0 }, { 1, 0, 3 }, { 1, 3, 3 }, { 2, 0, 0 },
+        { 20, 27, 0 }, { 20, 28, 3 }, { 20, 32, 3 }, { 20, 35, 3 }, { 20, 36, 1 }, { 20, 39, 1 }, { 20, 40, 0 }
+    };
+
+    bool passed = true;
+    for (const ExpectedPixel& pixel : expected)
+    {
+        uint8_t shade = gameBoy.ppu().frameBuffer[pixel.line][pixel.x];
+        if (shade != pixel.shade)
+        {
+            printf("Line %d x %d: expected shade %d, got %d\n", pixel.line, pixel.x, pixel.shade, shade);
+            passed = false;
+        }
+    }
+
+    if (passed) printf("sprite clipping and priority: passed\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <vector>
+
+#include "gameBoy.hpp"
+#include "Cartridge/cartridgeBuilder.hpp"
+
+#include "romImage.hpp"
+
+//Upper bound for the boot ROM to hand over and the program to finish
+#define TEST_FRAMES 1000
+
+#define READY_ADDRESS 0xC000
+#define READY_VALUE 0x42
+
+struct ExpectedValue
+{
+    const char* name;
+    uint16_t address;
+    uint8_t mask;
+    uint8_t value;
+};
+
+/**
+ * Reads STAT right after LYC or STAT itself were written, in V-Blank and in H-Blank.
+ * The mode and the LY compare bit have to be those of the current cycle, not the ones
+ * of the last mode change.
+ */
+static bool testStatusReads(CpuBackend backend, const char* backendName)
+{
+    RomImage image(ROM_TYPE_STANDARD);
+    image.place(ROM_PROGRAM_START, {
+        //DI; wait for LY == 150
+        0xF3, 0xF0, 0x44, 0xFE, 0x96, 0x20, 0xFA,
+        //LYC = 150; LD (0xC001),STAT
+        0x3E, 0x96, 0xE0, 0x45, 0xF0, 0x41, 0xEA, 0x01, 0xC0,
+        //STAT = 0; LD (0xC002),STAT
+        0xAF, 0xE0, 0x41, 0xF0, 0x41, 0xEA, 0x02, 0xC0,
+        //Wait for LY == 10, then for H-Blank
+        0xF0, 0x44, 0xFE, 0x0A, 0x20, 0xFA, 0xF0, 0x41, 0xE6, 0x03, 0x20, 0xFA,
+        //LD (0xC003),LY; LYC = 10; LD (0xC004),STAT
+        0xF0, 0x44, 0xEA, 0x03, 0xC0, 0x3E, 0x0A, 0xE0, 0x45, 0xF0, 0x41, 0xEA, 0x04, 0xC0,
+        //LD A,READY_VALUE; LD (READY_ADDRESS),A; JR -2
+        0x3E, READY_VALUE, 0xEA, 0x00, 0xC0, 0x18, 0xFE
+    });
+
+    std::string romFile = image.write("gbemu_ppu_status_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return false;
+    }
+
+    GameBoy gameBoy(CartridgeBuilder::openROM(romFile.c_str()));
+    gameBoy.setCpuBackend(backend);
+    MemoryBus& bus = gameBoy.memoryBus();
+    for (int frame = 0; frame < TEST_FRAMES && bus.readMemoryBus(READY_ADDRESS) != READY_VALUE; frame++)
+    {
+        gameBoy.runFrame();
+    }
+    if (bus.readMemoryBus(READY_ADDRESS) != READY_VALUE)
+    {
+        printf("status reads, %s: the test program did not finish\n", backendName);
+        return false;
+    }
+
+    const ExpectedValue expected[] = {
+        { "STAT after LYC was written in V-Blank", 0xC001, 0x07, LY_COMPARE_BIT | (uint8_t)PPUState::V_BLANK_MODE_1 },
+        { "STAT after STAT was written", 0xC002, 0xFF, LY_COMPARE_BIT | (uint8_t)PPUState::V_BLANK_MODE_1 },
+        { "LY in H-Blank", 0xC003, 0xFF, 10 },
+        { "STAT after LYC was written in H-Blank", 0xC004, 0xFF, LY_COMPARE_BIT | (uint8_t)PPUState::H_BLANK_MODE_0 }
+    };
+
+    bool passed = true;
+    for (const ExpectedValue& value : expected)
+    {
+        uint8_t read = bus.readMemoryBus(value.address) & value.mask;
+        if (read != value.value)
+        {
+            printf("status reads, %s: %s is %02X, expected %02X\n", backendName, value.name, read, value.value);
+            passed = false;
+        }
+    }
+
+    if (passed) printf("status reads, %s: passed\n", backendName);
+    return passed;
+}
+
+int main()
+{
+    bool passed = true;
+    passed &= testStatusReads(CpuBackend::INTERPRETER, "interpreter");
+    passed &= testStatusReads(CpuBackend::DECODED_BLOCKS, "decoded blocks");
+    return passed ? 0 : 1;
+}
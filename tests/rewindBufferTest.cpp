@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <vector>
+
+#include "gameBoy.hpp"
+#include "rewindBuffer.hpp"
+#include "Cartridge/cartridgeBuilder.hpp"
+
+#include "romImage.hpp"
+
+//Small enough that the captures wrap around the storage several times
+#define TEST_CAPACITY 4096
+#define TEST_FRAMES 300
+
+//Bytes of WRAM changed between two captures, so the entries differ in size
+#define MIN_CHANGED_BYTES 16
+#define MAX_CHANGED_BYTES 128
+
+//Fixed seed, every run writes the same bytes
+static uint32_t nextRandom(uint32_t& seed)
+{
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+/**
+ * Captures every frame into a buffer that wraps around many times, then rewinds through
+ * all remaining entries. Every restored machine has to match the snapshot taken at
+ * that frame, also behind the points where the storage wrapped.
+ */
+static bool testRewindAcrossWrap()
+{
+    RomImage image(ROM_TYPE_STANDARD);
+    //JR -2
+    image.place(ROM_PROGRAM_START, { 0x18, 0xFE });
+
+    std::string romFile = image.write("gbemu_rewind_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return false;
+    }
+
+    GameBoy gameBoy(CartridgeBuilder::openROM(romFile.c_str()));
+    RewindBuffer rewind(TEST_CAPACITY);
+
+    std::vector<std::vector<uint8_t>> history;
+    uint32_t seed = 1;
+    for (int frame = 0; frame < TEST_FRAMES; frame++)
+    {
+        uint32_t changed = MIN_CHANGED_BYTES + nextRandom(seed) % (MAX_CHANGED_BYTES - MIN_CHANGED_BYTES + 1);
+        for (uint32_t i = 0; i < changed; i++)
+        {
+            gameBoy.memoryBus().writeMemoryBus(0xC000 + nextRandom(seed) % 0x2000, (uint8_t)nextRandom(seed));
+        }
+        gameBoy.runFrame();
+        rewind.capture(gameBoy);
+
+        history.emplace_back();
+        gameBoy.snapshot(history.back());
+    }
+
+    //The first capture has nothing to delta against, so without a wrap every later one is kept
+    if (rewind.entries() + 1 >= history.size() || rewind.entries() < 2)
+    {
+        printf("rewind across wrap: the storage never wrapped\n");
+        return false;
+    }
+
+    size_t entries = rewind.entries();
+    std::vector<uint8_t> state;
+    for (size_t i = 1; i <= entries; i++)
+    {
+        if (!rewind.rewind(gameBoy))
+        {
+            printf("rewind across wrap: rewind %zu of %zu failed\n", i, entries);
+            return false;
+        }
+
+        gameBoy.snapshot(state);
+        if (state != history[history.size() - 1 - i])
+        {
+            printf("rewind across wrap: rewind %zu of %zu restored a different machine\n", i, entries);
+            return false;
+        }
+    }
+
+    if (rewind.rewind(gameBoy))
+    {
+        printf("rewind across wrap: rewound past the oldest entry\n");
+        return false;
+    }
+
+    printf("rewind across wrap: passed, %zu entries\n", entries);
+    return true;
+}
+
+int main()
+{
+    bool passed = true;
+    passed &= testRewindAcrossWrap();
+    return passed ? 0 : 1;
+}
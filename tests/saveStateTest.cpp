@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <vector>
+
+#include "gameBoy.hpp"
+#include "Cartridge/cartridgeBuilder.hpp"
+
+#include "romImage.hpp"
+
+#define TEST_FRAMES 60
+
+//A state that does not match the layout is rejected without touching the machine
+static bool testRestoreRejectsWholeState(const char* name, GameBoy& gameBoy, const std::vector<uint8_t>& state)
+{
+    std::vector<uint8_t> before, after;
+    gameBoy.snapshot(before);
+
+    if (gameBoy.restore(state))
+    {
+        printf("%s: restore accepted the state\n", name);
+        return false;
+    }
+
+    gameBoy.snapshot(after);
+    if (before != after)
+    {
+        printf("%s: the rejected state changed the machine\n", name);
+        return false;
+    }
+
+    printf("%s: passed\n", name);
+    return true;
+}
+
+int main()
+{
+    RomImage image(ROM_TYPE_STANDARD);
+    //INC A; LD (0xC000),A; JR -6
+    image.place(ROM_PROGRAM_START, { 0x3C, 0xEA, 0x00, 0xC0, 0x18, 0xFA });
+
+    std::string romFile = image.write("gbemu_save_state_test.gb");
+    if (romFile.empty())
+    {
+        printf("Could not write the test ROM\n");
+        return 1;
+    }
+
+    GameBoy gameBoy(CartridgeBuilder::openROM(romFile.c_str()));
+    std::vector<uint8_t> state;
+    gameBoy.snapshot(state);
+    for (int frame = 0; frame < TEST_FRAMES; frame++) gameBoy.runFrame();
+
+    std::vector<uint8_t> truncated(state.begin(), state.end() - 1);
+    std::vector<uint8_t> extended(state);
+    extended.push_back(0);
+
+    bool passed = true;
+    passed &= testRestoreRejectsWholeState("extended state", gameBoy, extended);
+    passed &= testRestoreRejectsWholeState("truncated state", gameBoy, truncated);
+
+    if (!gameBoy.restore(state) || gameBoy.frameCount() != 0)
+    {
+        printf("valid state: restore failed\n");
+        passed = false;
+    }
+    return passed ? 0 : 1;
+}